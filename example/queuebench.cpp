@@ -0,0 +1,50 @@
+//跨线程向EventLoop投递任务的吞吐量测试
+//用法: ./QueueBench [生产者线程数] [每个线程投递的任务数]
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    int producers = argc > 1 ? atoi(argv[1]) : 4;
+    int perThread = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    EventLoopThread loopThread;
+    EventLoop *loop = loopThread.startLoop();
+
+    std::atomic<long> done(0);
+    long total = static_cast<long>(producers) * perThread;
+    size_t wakeupsBefore = loop->wakeupCount();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([loop, perThread, &done]() {
+            for (int j = 0; j < perThread; ++j)
+            {
+                loop->queueInLoop([&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+            }
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    // 等loop线程执行完所有任务
+    while (done.load() < total)
+    {
+        std::this_thread::yield();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("producers=%d tasks=%ld time=%.3fs throughput=%.0f tasks/s wakeups=%zu\n",
+           producers, total, seconds, total / seconds, loop->wakeupCount() - wakeupsBefore);
+    return 0;
+}
@@ -0,0 +1,128 @@
+//MpscQueue的多生产者压力测试,检查元素不丢、同一生产者的元素保持顺序、不会有元素滞留在队列中,
+//以及consume()每轮只处理调用时已经在队列中的元素
+//用法: ./QueueStress [生产者线程数] [每个线程的元素数] [轮数]
+//失败时返回1
+#include "MpscQueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const int kSeqBits = 40;
+
+//生产者时快时慢,让队列经常在空和非空之间切换,消费者放回stub时更容易和push撞在一起
+bool runRound(int producers, long perThread)
+{
+    MpscQueue<uint64_t> queue;
+    std::atomic<int> finished(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&queue, &finished, i, perThread]() {
+            for (long j = 0; j < perThread; ++j)
+            {
+                queue.push((static_cast<uint64_t>(i) << kSeqBits) | static_cast<uint64_t>(j));
+                if ((j & 0x3ff) == static_cast<long>(i))
+                {
+                    std::this_thread::yield();
+                }
+            }
+            finished.fetch_add(1);
+        });
+    }
+
+    std::vector<long> next(producers, 0);
+    long total = static_cast<long>(producers) * perThread;
+    long received = 0;
+    bool ok = true;
+    auto stalledSince = std::chrono::steady_clock::now();
+    bool stalled = false;
+    while (received < total && ok)
+    {
+        size_t n = queue.consume([&](uint64_t &value) {
+            int producer = static_cast<int>(value >> kSeqBits);
+            long seq = static_cast<long>(value & ((static_cast<uint64_t>(1) << kSeqBits) - 1));
+            if (seq != next[producer])
+            {
+                printf("producer %d: expected %ld, got %ld\n", producer, next[producer], seq);
+                ok = false;
+            }
+            next[producer] = seq + 1;
+            ++received;
+        });
+        if (n > 0 || finished.load() < producers)
+        {
+            stalled = false;
+            continue;
+        }
+        //所有生产者都结束了,队列仍然非空却取不出元素
+        if (!stalled)
+        {
+            stalled = true;
+            stalledSince = std::chrono::steady_clock::now();
+        }
+        else if (std::chrono::steady_clock::now() - stalledSince > std::chrono::seconds(1))
+        {
+            printf("stranded: received %ld of %ld, empty()=%d\n", received, total, queue.empty() ? 1 : 0);
+            ok = false;
+        }
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    if (ok && !queue.empty())
+    {
+        printf("queue not empty after all elements were received\n");
+        ok = false;
+    }
+    return ok;
+}
+
+//元素在处理时把自己重新放回队列,每轮consume只能处理一个
+bool runRequeue()
+{
+    MpscQueue<int> queue;
+    queue.push(0);
+    for (int round = 0; round < 1000; ++round)
+    {
+        size_t n = queue.consume([&queue](int &value) { queue.push(value + 1); });
+        if (n != 1)
+        {
+            printf("requeue: round %d processed %zu elements\n", round, n);
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    int producers = argc > 1 ? atoi(argv[1]) : 4;
+    long perThread = argc > 2 ? atol(argv[2]) : 200000;
+    int rounds = argc > 3 ? atoi(argv[3]) : 20;
+
+    if (!runRequeue())
+    {
+        return 1;
+    }
+    for (int i = 0; i < rounds; ++i)
+    {
+        if (!runRound(producers, perThread))
+        {
+            printf("round %d failed\n", i);
+            return 1;
+        }
+    }
+    printf("producers=%d elements=%ld rounds=%d ok\n", producers, perThread * producers, rounds);
+    return 0;
+}
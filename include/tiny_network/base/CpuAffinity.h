@@ -0,0 +1,24 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <vector>
+
+//线程绑核和NUMA拓扑查询,不依赖libnuma,拓扑信息从/sys/devices/system读取
+namespace CpuAffinity
+{
+    //当前进程允许使用的CPU编号
+    std::vector<int> allowedCpus();
+
+    //每个物理核取一个CPU排在前面,超线程的兄弟CPU排在后面
+    //线程数不超过物理核数时不会有两个线程共享一个核
+    std::vector<int> onePerCore();
+
+    //CPU所在的NUMA节点,读取不到时返回0
+    int numaNodeOfCpu(int cpu);
+
+    //把当前线程绑定到cpu,并让之后的内存分配优先使用该CPU所在的NUMA节点
+    //成功返回true,失败时记录日志,线程保持原来的亲和性
+    bool bindCurrentThread(int cpu);
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef INLINE_FUNCTION_H
+#define INLINE_FUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//只能移动的void()可调用对象,用来代替EventLoop任务、定时器回调和线程池任务中的std::function
+//不超过kInlineSize字节的闭包(如绑定this和一个std::string的std::bind)直接放在对象内部,不分配内存
+//因为不要求可拷贝,闭包里可以放std::unique_ptr,跨线程发送的数据也可以移动进来而不是拷贝
+class InlineFunction
+{
+public:
+    static const size_t kInlineSize = 64;
+
+    InlineFunction() noexcept : ops_(nullptr) {}
+    InlineFunction(std::nullptr_t) noexcept : ops_(nullptr) {}
+
+    template <typename F,
+              typename = typename std::enable_if<
+                  !std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction(F &&f)
+        : ops_(nullptr)
+    {
+        using Fn = typename std::decay<F>::type;
+        init<Fn>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Fn>()>());
+    }
+
+    InlineFunction(InlineFunction &&other) noexcept
+        : ops_(nullptr)
+    {
+        moveFrom(other);
+    }
+
+    InlineFunction &operator=(InlineFunction &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    InlineFunction &operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    InlineFunction(const InlineFunction &) = delete;
+    InlineFunction &operator=(const InlineFunction &) = delete;
+
+    ~InlineFunction()
+    {
+        reset();
+    }
+
+    void operator()() const
+    {
+        ops_->invoke(&storage_);
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ops_ != nullptr;
+    }
+
+    bool operator==(std::nullptr_t) const noexcept { return ops_ == nullptr; }
+    bool operator!=(std::nullptr_t) const noexcept { return ops_ != nullptr; }
+
+private:
+    using Storage = typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type;
+
+    //每种闭包类型一张函数表,代替虚函数
+    struct Ops
+    {
+        void (*invoke)(void *storage);
+        void (*relocate)(void *dst, void *src);//把src中的闭包移动到dst,src随后视为空
+        void (*destroy)(void *storage);
+    };
+
+    //移动构造可能抛异常的闭包放在堆上,保证InlineFunction自身的移动不抛异常
+    template <typename Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(Storage) &&
+               std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template <typename Fn>
+    struct InlineOps
+    {
+        static void invoke(void *storage) { (*static_cast<Fn *>(storage))(); }
+        static void relocate(void *dst, void *src)
+        {
+            Fn *from = static_cast<Fn *>(src);
+            new (dst) Fn(std::move(*from));
+            from->~Fn();
+        }
+        static void destroy(void *storage) { static_cast<Fn *>(storage)->~Fn(); }
+        static const Ops ops;
+    };
+
+    template <typename Fn>
+    struct HeapOps
+    {
+        static Fn *&get(void *storage) { return *static_cast<Fn **>(storage); }
+        static void invoke(void *storage) { (*get(storage))(); }
+        static void relocate(void *dst, void *src) { new (dst) Fn *(get(src)); }
+        static void destroy(void *storage) { delete get(storage); }
+        static const Ops ops;
+    };
+
+    template <typename Fn, typename F>
+    void init(F &&f, std::true_type)
+    {
+        new (&storage_) Fn(std::forward<F>(f));
+        ops_ = &InlineOps<Fn>::ops;
+    }
+
+    template <typename Fn, typename F>
+    void init(F &&f, std::false_type)
+    {
+        new (&storage_) Fn *(new Fn(std::forward<F>(f)));
+        ops_ = &HeapOps<Fn>::ops;
+    }
+
+    void moveFrom(InlineFunction &other) noexcept
+    {
+        if (other.ops_)
+        {
+            other.ops_->relocate(&storage_, &other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    void reset() noexcept
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    mutable Storage storage_;
+    const Ops *ops_;
+};
+
+template <typename Fn>
+const InlineFunction::Ops InlineFunction::InlineOps<Fn>::ops = {
+    &InlineFunction::InlineOps<Fn>::invoke,
+    &InlineFunction::InlineOps<Fn>::relocate,
+    &InlineFunction::InlineOps<Fn>::destroy};
+
+template <typename Fn>
+const InlineFunction::Ops InlineFunction::HeapOps<Fn>::ops = {
+    &InlineFunction::HeapOps<Fn>::invoke,
+    &InlineFunction::HeapOps<Fn>::relocate,
+    &InlineFunction::HeapOps<Fn>::destroy};
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <utility>
+#include <stddef.h>
+
+//无锁的多生产者单消费者队列(Vyukov的侵入式链表队列)
+//任意线程都可以push,只有一个线程可以pop,push只有一次原子交换,不会阻塞
+//生产者在exchange和链接next之间被打断时,消费者会暂时看不到这个元素(pop返回false),
+//但empty()仍然返回false,所以消费者不会因此睡死
+//T需要可以默认构造和移动
+template <typename T>
+class MpscQueue : noncopyable
+{
+public:
+    MpscQueue()
+        : head_(&stub_),
+          tail_(&stub_)
+    {
+        stub_.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~MpscQueue()
+    {
+        T value;
+        while (pop(&value))
+        {
+        }
+    }
+
+    //任意线程调用
+    void push(T &&value)
+    {
+        pushNode(new Node(std::move(value)));
+    }
+
+    //只能在消费者线程调用,队列为空或者下一个元素还没链接好时返回false
+    bool pop(T *value)
+    {
+        Node *node = popNode();
+        if (node == nullptr)
+        {
+            return false;
+        }
+        *value = std::move(node->value);
+        delete node;
+        return true;
+    }
+
+    //只能在消费者线程调用,依次取出调用时已经在队列中的元素交给f,返回处理的个数
+    //f执行期间新加入的元素留到下一次,避免f不断向队列添加元素时一直处理不完
+    //maxCount不为0时最多处理maxCount个,剩下的留在队列中
+    template <typename F>
+    size_t consume(F &&f, size_t maxCount = 0)
+    {
+        //本轮的终点是调用时最后加入的节点
+        //如果是stub(队列为空,或者消费者放回stub时恰好有生产者加入),popNode不会返回它,
+        //它前面的元素都属于本轮,取到stub位于队尾时结束
+        Node *last = head_.load(std::memory_order_acquire);
+        size_t n = 0;
+        Node *node;
+        while ((maxCount == 0 || n < maxCount)
+               && !(last == &stub_ && tail_ == &stub_)
+               && (node = popNode()) != nullptr)
+        {
+            bool done = node == last;
+            T value(std::move(node->value));
+            delete node;
+            ++n;
+            f(value);
+            if (done)
+            {
+                break;
+            }
+        }
+        return n;
+    }
+
+    //只能在消费者线程调用,和生产者的push构成seq_cst的先后关系,用于判断能否睡眠
+    //只有stub同时位于队头和队尾时才是空的
+    bool empty() const
+    {
+        return tail_ == &stub_ && head_.load(std::memory_order_seq_cst) == &stub_;
+    }
+
+private:
+    struct Node
+    {
+        Node() : next(nullptr) {}
+        explicit Node(T &&v) : next(nullptr), value(std::move(v)) {}
+        std::atomic<Node *> next;
+        T value;
+    };
+
+    //取出队尾节点,调用方负责delete
+    Node *popNode()
+    {
+        Node *tail = tail_;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_)
+        {
+            if (next == nullptr)
+            {
+                return nullptr;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next)
+        {
+            tail_ = next;
+            return tail;
+        }
+        //tail是最后一个节点,先把stub放回队尾才能取走它
+        if (tail != head_.load(std::memory_order_acquire))
+        {
+            return nullptr;//有生产者正在链接新节点
+        }
+        pushNode(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next)
+        {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    void pushNode(Node *node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node *prev = head_.exchange(node, std::memory_order_seq_cst);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    std::atomic<Node *> head_;//生产者一端
+    Node *tail_;//消费者一端,只有消费者访问
+    Node stub_;
+};
+
+#endif
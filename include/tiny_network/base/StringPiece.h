@@ -0,0 +1,53 @@
+#ifndef STRING_PIECE_H
+#define STRING_PIECE_H
+
+#include <string>
+#include <string.h>
+#include <strings.h>
+
+//不持有数据的字符串视图,只保存首地址和长度,用于在不拷贝的情况下引用缓冲区中的一段数据
+//被引用的数据必须比StringPiece活得更久
+class StringPiece
+{
+public:
+    StringPiece()
+        : ptr_(NULL), length_(0) {}
+    StringPiece(const char* str)
+        : ptr_(str), length_(strlen(str)) {}
+    StringPiece(const std::string& str)
+        : ptr_(str.data()), length_(str.size()) {}
+    StringPiece(const char* offset, size_t len)
+        : ptr_(offset), length_(len) {}
+
+    const char* data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char* begin() const { return ptr_; }
+    const char* end() const { return ptr_ + length_; }
+
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    bool operator==(const StringPiece& x) const
+    {
+        return length_ == x.length_ && memcmp(ptr_, x.ptr_, length_) == 0;
+    }
+    bool operator!=(const StringPiece& x) const
+    {
+        return !(*this == x);
+    }
+
+    //忽略大小写比较,用于HTTP头部字段名
+    bool equalsIgnoreCase(const StringPiece& x) const
+    {
+        return length_ == x.length_ && strncasecmp(ptr_, x.ptr_, length_) == 0;
+    }
+
+    //拷贝出一个std::string
+    std::string toString() const { return std::string(ptr_, length_); }
+
+private:
+    const char* ptr_;
+    size_t length_;
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "noncopyable.h"
 #include "Thread.h"
+#include "InlineFunction.h"
 #include "../log/Logging.h"
 
 #include <deque>
@@ -13,6 +14,7 @@
 class ThreadPool : noncopyable{
 public:
     using ThreadFunction = std::function<void()>;
+    using Task = InlineFunction;//任务只能移动,小闭包不分配内存
     explicit ThreadPool(const std::string& name = std::string("ThreadPool"));
     ~ThreadPool();
 
@@ -24,6 +26,12 @@ public:
         threadSize_ = numThreads;
     }
 
+    //start之前调用,第i个线程绑定到cpus[i % cpus.size()],为空表示不绑定
+    //CpuAffinity::onePerCore()给出每个物理核一个线程的布局
+    void setCpuAffinity(const std::vector<int>& cpus){
+        cpus_ = cpus;
+    }
+
     void start();
 
     void stop();
@@ -33,12 +41,12 @@ public:
 
     size_t queueSize() const;
 
-    void addTask(ThreadFunction& task);
+    void addTask(Task task);
 
 
 private:
     bool isFull() const; //判断线程池是否满
-    void runInThread(); //线程池中的线程执行的函数
+    void runInThread(int index); //线程池中的线程执行的函数,index为线程编号
 
     mutable std::mutex mutex_; //互斥锁 
     //mutable表示可以在const函数中修改
@@ -46,7 +54,8 @@ private:
     std::string name_; //线程池名字
     ThreadFunction threadInitCallback_;//线程初始化回调函数    
     std::vector<std::unique_ptr<Thread>> threads_; //线程池中的线程
-    std::deque<ThreadFunction> queue_; //任务队列
+    std::deque<Task> queue_; //任务队列
+    std::vector<int> cpus_; //各线程绑定的CPU
 
     size_t threadSize_; //任务队列最大长度
     bool running_; //线程池是否运行
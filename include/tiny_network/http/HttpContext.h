@@ -3,8 +3,13 @@
 
 
 #include "HttpRequest.h"
+#include "DelimiterScanner.h"
+
+#include <functional>
+#include <memory>
 
 class Buffer;
+class HttpResponseWriter;
 class HttpContext
 {
 public:
@@ -12,39 +17,122 @@ public:
     {
         kExpectRequestLine, // 解析请求行状态
         kExpectHeaders,     // 解析请求头部状态
-        kExpectBody,        // 解析请求体状态
+        kExpectBody,        // 解析请求体状态(Content-Length)
+        kExpectChunkSize,   // 解析chunk大小行
+        kExpectChunkData,   // 解析chunk数据
+        kExpectChunkEnd,    // chunk数据后面的\r\n
+        kExpectTrailers,    // 最后一个chunk之后的trailer头部
         kGotAll,            // 解析完毕状态
     };
 
+    //解析失败的原因,HttpServer据此决定回复400还是413
+    enum ParseError
+    {
+        kNoError,
+        kBadRequest,
+        kBodyTooLarge,
+    };
+
+    //流式接收请求体时,每到达一段数据回调一次,data直接指向输入缓冲区,只在回调期间有效
+    using BodyCallback = std::function<void(const HttpRequest&, StringPiece data)>;
+
+    static const size_t kDefaultMaxBodySize = 1024 * 1024;
+    static const size_t kDefaultStreamThreshold = 64 * 1024;
+
     HttpContext()
-        : state_(kExpectRequestLine)
+        : state_(kExpectRequestLine),
+          parsed_(0),
+          error_(kNoError),
+          bodyRemaining_(0),
+          bodyReceived_(0),
+          streaming_(false),
+          maxBodySize_(kDefaultMaxBodySize),
+          maxStreamBodySize_(0),
+          streamThreshold_(kDefaultStreamThreshold)
     {
     }
 
+    //缓存在内存中的请求体上限,超过时解析失败并回复413
+    void setMaxBodySize(size_t bytes) { maxBodySize_ = bytes; }
+    //流式接收的请求体上限,0表示不限制
+    void setMaxStreamBodySize(size_t bytes) { maxStreamBodySize_ = bytes; }
+
+    //设置后,Content-Length超过threshold或者chunked编码的请求体不再缓存,边到达边交给cb
+    void setBodyCallback(const BodyCallback& cb, size_t threshold = kDefaultStreamThreshold)
+    {
+        bodyCallback_ = cb;
+        streamThreshold_ = threshold;
+    }
+
+    //解析过程中不从buf中取走数据,request()中的StringPiece直接指向buf,
+    //处理完请求后调用方再retrieve(consumedBytes())
     bool parseRequest(Buffer* buf, TimeStamp receiveTime);
 
+    //当前请求已经解析掉的字节数
+    size_t consumedBytes() const
+    {
+        return parsed_;
+    }
+
     bool gotAll() const
     {
         return state_ == kGotAll;
     }
 
+    ParseError error() const
+    {
+        return error_;
+    }
+
     void reset()
     {
         state_ = kExpectRequestLine;
-        HttpRequest dummy;
-        request_.swap(dummy);
+        parsed_ = 0;
+        error_ = kNoError;
+        bodyRemaining_ = 0;
+        bodyReceived_ = 0;
+        streaming_ = false;
+        lineScan_.reset();
+        request_.reset();
     }
 
     const HttpRequest& request() const
     {
         return request_;
     }
+
+    //正在发送的流式响应,发送完之前不处理流水线上的后续请求
+    void setResponseWriter(const std::shared_ptr<HttpResponseWriter>& writer)
+    {
+        writer_ = writer;
+    }
+
+    const std::shared_ptr<HttpResponseWriter>& responseWriter() const
+    {
+        return writer_;
+    }
     
 private:
     bool processRequestLine(const char* begin, const char* end);
+    //头部解析完后根据Content-Length和Transfer-Encoding决定如何接收请求体
+    bool processHeadersEnd(Buffer* buf);
+    //请求体的一段数据到达,流式模式下交给回调并从缓冲区中取走,否则只记录
+    bool onBodyData(Buffer* buf, size_t len);
+    bool overLimit(size_t total) const;
 
     HttpRequestParseState state_;
     HttpRequest request_;
+    size_t parsed_;//当前请求已经解析的字节数,相对buf->beginRead()
+    DelimiterScanner::LineScan lineScan_;//当前行的扫描进度,一行分多次到达时不重复扫描
+    ParseError error_;
+    size_t bodyRemaining_;//Content-Length或当前chunk还没收到的字节数
+    size_t bodyReceived_;//已经收到的请求体字节数
+    bool streaming_;//当前请求的请求体是否流式交给bodyCallback_
+    size_t maxBodySize_;
+    size_t maxStreamBodySize_;
+    size_t streamThreshold_;
+    BodyCallback bodyCallback_;
+    std::shared_ptr<HttpResponseWriter> writer_;
 };
 
 #endif
\ No newline at end of file
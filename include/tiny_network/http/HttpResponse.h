@@ -3,9 +3,17 @@
 
 #include <unordered_map>
 #include <string>
+#include <memory>
+#include <functional>
+#include <sys/types.h>
 class Buffer;
+class OutputQueue;
+class HttpResponseWriter;
 class HttpResponse{
 public:
+    //流式响应体的生产者,连接可写时被反复调用,每次写一部分,写完后调用writer->finish()
+    using StreamCallback = std::function<void(const std::shared_ptr<HttpResponseWriter>&)>;
+
     enum HttpStatusCode{
         kUnknown,
         k200Ok = 200,
@@ -15,8 +23,21 @@ public:
     };
     explicit HttpResponse(bool close)
         :statusCode_(kUnknown),
-        closeConnection_(close){
+        closeConnection_(close),
+        bodyFd_(-1),
+        bodyFileOffset_(0),
+        bodyFileLength_(0),
+        streamLength_(-1),
+        cacheTtl_(-1){
     }
+    //文件响应体的fd没有交给输出队列时在这里close
+    ~HttpResponse();
+    //持有fd,只能移动
+    HttpResponse(HttpResponse&& other);
+    HttpResponse& operator=(HttpResponse&& other);
+    HttpResponse(const HttpResponse&) = delete;
+    HttpResponse& operator=(const HttpResponse&) = delete;
+
     void setStatusCode(HttpStatusCode code){
         statusCode_ = code;
     }
@@ -45,15 +66,86 @@ public:
         body_ = body;
     }
 
+    //以文件区间作为响应体,由HttpServer通过sendfile零拷贝发送
+    //fd的所有权交给响应,moveToQueue时转给输出队列,没有发出时由析构函数close
+    void setBodyFile(int fd, off_t offset, size_t length){
+        closeBodyFile();
+        bodyFd_ = fd;
+        bodyFileOffset_ = offset;
+        bodyFileLength_ = length;
+    }
+
+    int bodyFd() const{
+        return bodyFd_;
+    }
+
+    off_t bodyFileOffset() const{
+        return bodyFileOffset_;
+    }
+
+    size_t bodyFileLength() const{
+        return bodyFileLength_;
+    }
+
+    //响应头立即发出,响应体由cb边生成边发送,不需要整个放进内存
+    //length未知(-1)时长连接用chunked编码,短连接以关闭连接表示结束
+    void setBodyStream(const StreamCallback& cb, ssize_t length = -1){
+        streamCallback_ = cb;
+        streamLength_ = length;
+    }
+
+    bool streaming() const{
+        return static_cast<bool>(streamCallback_);
+    }
+
+    const StreamCallback& streamCallback() const{
+        return streamCallback_;
+    }
+
+    ssize_t streamLength() const{
+        return streamLength_;
+    }
+
+    //流式响应体是否需要chunked编码
+    bool chunked() const{
+        return streaming() && streamLength_ < 0 && !closeConnection_;
+    }
+
+    //允许HttpServer缓存这个响应,ttl秒内相同的请求直接返回缓存的字节,不再调用回调
+    //ttl为0时使用HttpServer的默认值;流式、文件和关闭连接的响应不会被缓存
+    void setCacheable(double ttl = 0){
+        cacheTtl_ = ttl;
+    }
+
+    bool cacheable() const{
+        return cacheTtl_ >= 0 && !streaming() && bodyFd_ < 0 && !closeConnection_;
+    }
+
+    double cacheTtl() const{
+        return cacheTtl_;
+    }
+
+    //序列化成完整的响应报文,不支持文件响应体(只能由moveToQueue发送)
     void appendToBuffer(Buffer* output) const;
+    void appendToString(std::string* output) const;
+    //状态行和头部序列化后转移到output,响应体直接移动过去,文件响应体的fd所有权也一并转移
+    void moveToQueue(OutputQueue* output);
 
 private:
+    void appendHeaders(std::string* output) const;
+    void closeBodyFile();
 
     std::unordered_map<std::string,std::string> headers_;
     HttpStatusCode statusCode_;
     bool closeConnection_;
     std::string statusMessage_;
     std::string body_;
+    int bodyFd_;//文件响应体,-1表示没有
+    off_t bodyFileOffset_;
+    size_t bodyFileLength_;
+    StreamCallback streamCallback_;
+    ssize_t streamLength_;
+    double cacheTtl_;//-1表示不缓存
 };
 
 
@@ -0,0 +1,41 @@
+#ifndef DELIMITER_SCANNER_H
+#define DELIMITER_SCANNER_H
+
+#include <sys/types.h>
+#include <stddef.h>
+
+//用SIMD一次扫描出一行中的\r\n、第一个':'和第一个' '的位置
+//运行时检测CPU,支持AVX2时每次处理32字节,否则用SSE2每次处理16字节,非x86平台逐字节扫描
+namespace DelimiterScanner
+{
+    //一行的扫描状态,所有位置都是相对行首的偏移,缓冲区搬移或扩容后仍然有效
+    //一行没有收全时保存已扫描的进度,下次从scanned继续,不会重复扫描
+    struct LineScan
+    {
+        LineScan() { reset(); }
+
+        void reset()
+        {
+            scanned = 0;
+            crlf = -1;
+            colon = -1;
+            space = -1;
+        }
+
+        size_t scanned; //已经扫描过的字节数
+        ssize_t crlf;   //\r\n的位置,-1表示还没找到
+        ssize_t colon;  //\r\n之前第一个':'的位置,-1表示没有
+        ssize_t space;  //\r\n之前第一个' '的位置,-1表示没有
+    };
+
+    //从begin + scan->scanned继续扫描到end,找到\r\n时返回true
+    bool scanLine(const char *begin, const char *end, LineScan *scan);
+
+    //在[begin, end)中查找\r\n,返回\r的地址,找不到返回nullptr
+    const char *findCRLF(const char *begin, const char *end);
+
+    //当前使用的实现:"avx2"、"sse2"或"scalar"
+    const char *implementation();
+}
+
+#endif
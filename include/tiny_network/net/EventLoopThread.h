@@ -19,6 +19,11 @@ public:
                     const std::string& name = std::string());
     ~EventLoopThread();
     EventLoop* startLoop();
+
+    //startLoop之前调用,线程启动后先绑定到cpu再创建EventLoop,
+    //这样loop自己分配的内存(缓冲区块池、定时器等)首次访问时落在该CPU所在的NUMA节点
+    void setCpu(int cpu) { cpu_ = cpu; }
+    int cpu() const { return cpu_; }
 private:
     void threadFunc();
 
@@ -28,6 +33,7 @@ private:
     std::mutex mutex_;
     std::condition_variable cond_;
     ThreadInitCallback callback_;
+    int cpu_;//绑定的CPU,-1表示不绑定
 };
 
 
@@ -5,16 +5,31 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <stdint.h>
 
 
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
 
 class EventLoopThreadPool
 {
 public:
 
     using ThreadInitCallback = std::function<void(EventLoop *)>;
+
+    //新连接分配到哪个IO线程
+    enum DispatchPolicy
+    {
+        kRoundRobin,        //轮流分配,默认
+        kLeastConnections,  //连接数最少的loop
+        kLeastPendingBytes, //输出队列中待发送字节最少的loop
+        kPowerOfTwoChoices, //随机选两个,取连接数少的,开销小且不会同时涌向同一个loop
+        kConsistentHash,    //按对端IP一致性哈希,同一客户端的连接落在同一个loop
+    };
+    //自定义分配策略,loops为所有IO线程的loop
+    using DispatchCallback = std::function<EventLoop *(const std::vector<EventLoop *> &loops,
+                                                       const InetAddress &peerAddr)>;
     EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
     ~EventLoopThreadPool();
 
@@ -24,6 +39,24 @@ public:
 
     EventLoop *getNextLoop();
 
+    //需在start之前设置,设置了DispatchCallback时优先使用它
+    void setDispatchPolicy(DispatchPolicy policy) { policy_ = policy; }
+    void setDispatchCallback(const DispatchCallback &cb) { dispatchCallback_ = cb; }
+
+    //start之前设置,第i个IO线程绑定到cpus[i % cpus.size()],为空表示不绑定
+    void setCpuAffinity(const std::vector<int> &cpus) { cpus_ = cpus; }
+    //每个物理核一个IO线程,见CpuAffinity::onePerCore
+    void setAutoCpuAffinity();
+
+    //新连接优先分配给和处理它网卡中断的CPU(SO_INCOMING_CPU)在同一NUMA节点上的loop,
+    //分配策略只在这些loop中选择;需要绑定CPU,kConsistentHash不受影响
+    void setPreferLocalNode(bool on) { preferLocalNode_ = on; }
+    bool preferLocalNode() const { return preferLocalNode_; }
+
+    //按分配策略为新连接选择loop,只能在一个线程中调用
+    //incomingCpu为内核处理该连接的CPU,-1表示未知
+    EventLoop *getLoopForConnection(const InetAddress &peerAddr, int incomingCpu = -1);
+
     std::vector<EventLoop *> getAllLoops();
 
     bool started() const { return started_; }
@@ -31,11 +64,26 @@ public:
     const std::string &name() const { return name_; }
 
 private:
+    const std::vector<EventLoop *> &localLoops(int incomingCpu) const;
+    EventLoop *roundRobin(const std::vector<EventLoop *> &loops);
+    EventLoop *leastLoaded(const std::vector<EventLoop *> &loops, bool byBytes) const;
+    EventLoop *powerOfTwoChoices(const std::vector<EventLoop *> &loops);
+    EventLoop *consistentHash(const InetAddress &peerAddr) const;
+
     EventLoop *baseLoop_; //主线程的loop
     std::string name_;//线程池的名字
     bool started_;
     int numThreads_;
     int next_;//下一个要分配的线程
+    DispatchPolicy policy_;
+    DispatchCallback dispatchCallback_;
+    uint64_t randomState_;//kPowerOfTwoChoices使用的随机数状态
+    std::vector<std::pair<uint32_t, EventLoop *>> hashRing_;//按哈希值排序的虚拟节点
+    std::vector<int> cpus_;//IO线程绑定的CPU
+    bool preferLocalNode_;
+    std::vector<int> cpuNodes_;//按CPU编号索引的NUMA节点
+    std::vector<std::vector<EventLoop *>> nodeLoops_;//按NUMA节点索引,绑定在该节点上的loop
+    size_t localNext_;//节点内轮询的计数
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     //unique_ptr是一个智能指针，
     //它的特点是：只能有一个指针指向它，当这个指针被销毁时，
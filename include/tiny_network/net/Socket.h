@@ -29,6 +29,7 @@ public:
     void setReuseAddr(bool on);//设置地址复用
     void setReusePort(bool on);//设置端口复用
     void setKeepAlive(bool on);//设置keepalive
+    bool setBusyPoll(int usec);//设置SO_BUSY_POLL,recv在没有数据时在驱动中轮询usec微秒
 
 private:
     const int sockfd_;
@@ -8,12 +8,15 @@
 #include "Acceptor.h"
 #include "noncopyable.h"
 #include "EventLoopThreadPool.h"
+#include "BufferBudget.h"
 
 #include <functional>
 #include <string>
 #include <memory>
 #include <unordered_map>
 #include <atomic>
+#include <mutex>
+#include <vector>
 
 class TcpServer : noncopyable
 {
@@ -53,6 +56,112 @@ public:
         writeCompleteCallback_ = cb;
     }
 
+    //所有连接缓冲区的内存预算,超出后连接读空时立即收缩缓冲区,0表示不限制
+    void setBufferMemoryLimit(size_t bytes)
+    {
+        bufferBudget_->setLimit(bytes);
+    }
+
+    //每隔seconds秒在每个IO线程中回收内存池里多余的空闲块,需在start之前设置,0表示不回收
+    void setBufferTrimInterval(double seconds)
+    {
+        bufferTrimInterval_ = seconds;
+    }
+
+    //所有连接缓冲区占用的存储大小
+    size_t bufferReservedBytes() const
+    {
+        return bufferBudget_->reservedBytes();
+    }
+
+    //所有连接缓冲区中尚未处理的数据量
+    size_t bufferUsedBytes() const
+    {
+        return bufferBudget_->usedBytes();
+    }
+
+    //IO线程的忙轮询:有活之后spinMicros微秒内不阻塞,socketBusyPollMicros>0时同时在连接上设置SO_BUSY_POLL
+    //需在start之前设置
+    void setBusyPoll(int64_t spinMicros, int socketBusyPollMicros = 0)
+    {
+        busyPollMicros_ = spinMicros;
+        socketBusyPollMicros_ = socketBusyPollMicros;
+    }
+
+    //新连接使用边沿触发,见TcpConnection::setEdgeTriggered,需在start之前设置
+    void setEdgeTriggered(bool on, bool keepWriteArmed = false)
+    {
+        edgeTriggered_ = on;
+        keepWriteArmed_ = keepWriteArmed;
+    }
+
+    //每隔interval秒在日志中输出各IO线程每秒的epoll_ctl次数,0表示不输出,需在start之前设置
+    void setLoopStatsInterval(double interval) { loopStatsInterval_ = interval; }
+
+    //IO线程每轮循环的工作量上限,见EventLoop::setMaxEventsPerPoll等,0表示不限制
+    //需在start之前设置
+    void setLoopBudgets(int maxEventsPerPoll, size_t maxFunctorsPerIteration, size_t maxReadBytesPerConnection)
+    {
+        maxEventsPerPoll_ = maxEventsPerPoll;
+        maxFunctorsPerIteration_ = maxFunctorsPerIteration;
+        maxReadBytesPerConnection_ = maxReadBytesPerConnection;
+    }
+
+    //每个IO线程各自创建一个SO_REUSEPORT的监听套接字,由内核把新连接分散到各个线程,
+    //连接直接在accept它的线程中处理,不再经过主loop;没有IO线程时不生效,需在start之前设置
+    void setAcceptorPerIoThread(bool on) { acceptorPerIoThread_ = on; }
+
+    //每次可读事件最多accept的连接数,需在start之前设置
+    void setMaxAcceptsPerWakeup(int n) { maxAcceptsPerWakeup_ = n; }
+
+    //文件描述符耗尽时被拒绝的连接数
+    uint64_t rejectedConnections() const;
+
+    //新连接分配到IO线程的策略,需在start之前设置
+    void setDispatchPolicy(EventLoopThreadPool::DispatchPolicy policy)
+    {
+        threadPool_->setDispatchPolicy(policy);
+    }
+    void setDispatchCallback(const EventLoopThreadPool::DispatchCallback &cb)
+    {
+        threadPool_->setDispatchCallback(cb);
+    }
+
+    //IO线程绑定CPU,见EventLoopThreadPool::setCpuAffinity,需在start之前设置
+    void setCpuAffinity(const std::vector<int> &cpus)
+    {
+        threadPool_->setCpuAffinity(cpus);
+    }
+    void setAutoCpuAffinity()
+    {
+        threadPool_->setAutoCpuAffinity();
+    }
+    //按SO_INCOMING_CPU把新连接分给同一NUMA节点上的IO线程,需在start之前设置
+    void setPreferLocalNode(bool on)
+    {
+        threadPool_->setPreferLocalNode(on);
+    }
+
+    //每隔interval秒在主loop中检查各IO线程的连接数,最多的loop超过平均值的ratio倍时
+    //把一部分连接迁移到连接最少的loop,每轮最多迁移maxPerRound个;interval为0表示不开启
+    //适合长连接,需在start之前设置
+    void setRebalance(double interval, double ratio = 1.25, int maxPerRound = 64)
+    {
+        rebalanceInterval_ = interval;
+        rebalanceRatio_ = ratio;
+        maxMigrationsPerRound_ = maxPerRound;
+    }
+
+    //连接空闲(没有收发数据)超过seconds秒后由服务器关闭,使用每个loop的时间轮计时,
+    //刷新不需要系统调用,适合大量长连接;0表示不限制,需在start之前设置
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+
+    //在每个连接所属的IO线程中对它调用cb,用于广播等,异步执行,start之后调用
+    void forEachConnection(const ConnectionCallback &cb);
+    //关闭所有连接的写端,输出队列发完后连接正常关闭,用于优雅退出
+    void shutdownAllConnections();
+    size_t connectionCount() const;
+
     void setThreadNum(int numThreads);
     void start();
 
@@ -72,16 +181,34 @@ public:
     }
 
 private:
-    void newConnection(int sockfd, const InetAddress &peerAddr);
+    //ioLoop为空时轮流选一个IO线程,否则连接放在ioLoop中(在ioLoop线程中调用)
+    void newConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    void establishConnection(const TcpConnectionPtr &conn);
     void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    void onConnectionMigrated(const TcpConnectionPtr &conn, EventLoop *from);
+    void rebalance();
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    //每个IO线程一个分片,连接的建立和销毁都在所属IO线程中修改自己的分片,
+    //锁只在跨线程遍历和迁移时才会有竞争
+    struct ConnectionShard
+    {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, TcpConnectionPtr> connections;
+    };
+    ConnectionShard *shardFor(EventLoop *loop) const;
+    static void forEachInLoop(ConnectionShard *shard, const ConnectionCallback &cb);
 
     EventLoop *loop_;
     const std::string ipPort_;
     const std::string name_;
     std::unique_ptr<Acceptor> acceptor_;
+    std::vector<std::unique_ptr<Acceptor>> ioAcceptors_;//每个IO线程的监听套接字
+    const InetAddress listenAddr_;
+    InetAddress localAddr_;//acceptor_实际绑定的地址
+    bool localAddrFixed_;//绑定的是具体IP,新连接的本地地址就是它,不用getsockname
+    const std::string connNamePrefix_;
+    bool acceptorPerIoThread_;
+    int maxAcceptsPerWakeup_;
 
     std::shared_ptr<EventLoopThreadPool> threadPool_;
 
@@ -92,8 +219,27 @@ private:
     ThreadInitCallback threadInitCallback_;
     std::atomic_int started_;
 
-    int nextConnId_;
-    ConnectionMap connections_;
+    std::atomic<uint64_t> nextConnId_;
+    std::vector<std::unique_ptr<ConnectionShard>> shards_;
+    std::unordered_map<EventLoop *, ConnectionShard *> shardByLoop_;//start之后不再修改
+
+    std::shared_ptr<BufferBudget> bufferBudget_;//连接持有引用,服务器析构后仍然有效
+    double bufferTrimInterval_;
+
+    int64_t busyPollMicros_;
+    int socketBusyPollMicros_;
+
+    bool edgeTriggered_;
+    bool keepWriteArmed_;
+    double loopStatsInterval_;
+    int maxEventsPerPoll_;
+    size_t maxFunctorsPerIteration_;
+    size_t maxReadBytesPerConnection_;
+    double rebalanceInterval_;
+    double rebalanceRatio_;
+    int maxMigrationsPerRound_;
+    double idleTimeout_;
+    std::shared_ptr<char> alive_;//主loop上的定时器没法取消,通过weak_ptr判断TcpServer是否已经析构
 };
 
 #endif
\ No newline at end of file
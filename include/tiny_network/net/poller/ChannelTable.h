@@ -0,0 +1,80 @@
+#ifndef CHANNEL_TABLE_H
+#define CHANNEL_TABLE_H
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+class Channel;
+
+//按fd直接索引的Channel表,fd是从小到大分配的连续整数,用vector代替哈希表,
+//增删查都是一次数组访问,不分配节点;数组按fd的最大值成倍增长
+//每个槽位有一个代数,fd每次注册新的Channel时加一
+//EventLoop分发一批事件时,前面的回调可能关闭某个fd并让新的Channel复用它,
+//分发前比较poll返回时记下的代数,丢弃已经被移除或替换的Channel的事件
+class ChannelTable
+{
+public:
+    ChannelTable() : size_(0) {}
+
+    Channel* find(int fd) const
+    {
+        return inRange(fd) ? slots_[fd].channel : nullptr;
+    }
+
+    //代数不同时返回nullptr
+    Channel* find(int fd, uint32_t generation) const
+    {
+        return inRange(fd) && slots_[fd].generation == generation ? slots_[fd].channel : nullptr;
+    }
+
+    uint32_t generation(int fd) const
+    {
+        return inRange(fd) ? slots_[fd].generation : 0;
+    }
+
+    //返回新的代数
+    uint32_t add(int fd, Channel* channel)
+    {
+        if(static_cast<size_t>(fd) >= slots_.size()){
+            size_t grown = slots_.empty() ? kInitSize : slots_.size() * 2;
+            slots_.resize(grown > static_cast<size_t>(fd) ? grown : static_cast<size_t>(fd) + 1);
+        }
+        Slot& slot = slots_[fd];
+        if(slot.channel == nullptr){
+            ++size_;
+        }
+        slot.channel = channel;
+        return ++slot.generation;
+    }
+
+    void remove(int fd)
+    {
+        if(inRange(fd) && slots_[fd].channel != nullptr){
+            slots_[fd].channel = nullptr;
+            --size_;
+        }
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    static const size_t kInitSize = 64;
+
+    struct Slot
+    {
+        Slot() : channel(nullptr), generation(0) {}
+        Channel* channel;
+        uint32_t generation;
+    };
+
+    bool inRange(int fd) const
+    {
+        return fd >= 0 && static_cast<size_t>(fd) < slots_.size();
+    }
+
+    std::vector<Slot> slots_;
+    size_t size_;//表中Channel的个数
+};
+
+#endif
@@ -31,6 +31,12 @@ public:
     //移除Channel
     //channel:需要移除的Channel
 
+    void flushUpdates() override;
+    //已注册Channel的EPOLL_CTL_MOD推迟到这里一起提交,
+    //一轮循环中先enable再disable的修改相互抵消,和epoll中已有事件相同的修改直接跳过
+
+    const char* name() const override { return "epoll"; }
+
 
 private:
     static const int kInitEventListSize = 16;//初始化epoll_event列表的大小
@@ -38,10 +44,12 @@ private:
     void fillActiveChannels(int numEvents,ChannelList* activeChannels) const;
 
     void update(int operation,Channel* channel);
+    static int kernelEvents(Channel* channel);//要注册到epoll中的事件
 
     int epollfd_;//epoll文件描述符
 
     EventList events_;//epoll_event列表
+    ChannelList pendingUpdates_;//等待提交修改的Channel
 };
 
 
@@ -4,9 +4,10 @@
 #include "noncopyable.h"
 #include "TimeStamp.h"
 #include "Channel.h"
+#include "ChannelTable.h"
 
 
-#include <unordered_map>
+#include <atomic>
 #include <vector>
 
 //库中多路时间分发器的核心IO复用类
@@ -34,16 +35,37 @@ public:
     //纯虚函数,移除Channel
     //channel:需要移除的Channel
 
+    virtual const char* name() const = 0;
+    //后端名称,如"epoll"、"io_uring"
+
     bool hasChannel(Channel* channel) const;
     //判断是否有该Channel
 
+    uint32_t generation(int fd) const { return channels_.generation(fd); }
+    //fd当前注册的代数,fd每注册一次Channel加一
+
+    bool isRegistered(int fd, uint32_t generation, Channel* channel) const
+    {
+        return channel != nullptr && channels_.find(fd, generation) == channel;
+    }
+    //channel是否仍以该代数注册在fd上,不访问channel本身,channel可能已经析构
+
     static Poller* newDefaultPoller(EventLoop* loop);
     //创建Poller对象
 
-protected:
-    using ChannelMap = std::unordered_map<int,Channel*>;//Channel映射表
+    void setMaxEvents(int maxEvents) { maxEvents_ = maxEvents; }
+    //一次poll最多返回的事件数,0表示不限制,没取到的就绪事件(水平触发)下一次poll还会返回
 
-    ChannelMap channels_;//Channel映射表
+    virtual void flushUpdates() {}
+    //提交延迟的关注事件修改,EventLoop在每次poll之前调用
+
+    uint64_t ctlCalls() const { return ctlCalls_.load(std::memory_order_relaxed); }
+    //累计的epoll_ctl调用次数,可以在任意线程读取
+
+protected:
+    ChannelTable channels_;//按fd索引的Channel表
+    int maxEvents_;
+    std::atomic<uint64_t> ctlCalls_;
 
 private:
     EventLoop* ownerLoop_;//拥有该Poller的EventLoop
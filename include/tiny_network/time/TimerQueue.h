@@ -3,6 +3,7 @@
 
 #include "TimeStamp.h"
 #include "Channel.h"
+#include "InlineFunction.h"
 
 #include <sys/timerfd.h>
 #include <string.h>
@@ -16,12 +17,12 @@ class Timer;
 class TimerQueue
 {
 public:
-    using TimerCallback = std::function<void()>;
+    using TimerCallback = InlineFunction;
 
     explicit TimerQueue(EventLoop * loop);
     ~TimerQueue();
 
-    void addTimer(const TimerCallback &cb,
+    void addTimer(TimerCallback cb,
                   TimeStamp when,
                   double interval);
 
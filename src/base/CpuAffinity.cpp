@@ -0,0 +1,129 @@
+#include "CpuAffinity.h"
+#include "../log/Logging.h"
+
+#include <sched.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <set>
+#include <utility>
+
+//set_mempolicy的MPOL_LOCAL,glibc没有包装这个系统调用
+static const int kMpolLocal = 4;
+
+//读取/sys下只有一个整数的文件,失败返回-1
+static int readIntFile(const char *path)
+{
+    FILE *fp = ::fopen(path, "r");
+    if (fp == nullptr)
+    {
+        return -1;
+    }
+    int value = -1;
+    if (::fscanf(fp, "%d", &value) != 1)
+    {
+        value = -1;
+    }
+    ::fclose(fp);
+    return value;
+}
+
+std::vector<int> CpuAffinity::allowedCpus()
+{
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (::sched_getaffinity(0, sizeof set, &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty())
+    {
+        long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+        for (int cpu = 0; cpu < n; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<int> CpuAffinity::onePerCore()
+{
+    std::vector<int> primary;
+    std::vector<int> siblings;
+    std::set<std::pair<int, int>> seenCores;//(package, core)
+    for (int cpu : allowedCpus())
+    {
+        char path[128];
+        snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        int package = readIntFile(path);
+        snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        int core = readIntFile(path);
+        //读不到拓扑时每个CPU当作一个核
+        if (core < 0 || seenCores.insert(std::make_pair(package, core)).second)
+        {
+            primary.push_back(cpu);
+        }
+        else
+        {
+            siblings.push_back(cpu);
+        }
+    }
+    primary.insert(primary.end(), siblings.begin(), siblings.end());
+    return primary;
+}
+
+int CpuAffinity::numaNodeOfCpu(int cpu)
+{
+    //cpuN目录下有一个指向所在节点的nodeM链接
+    char path[64];
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = ::opendir(path);
+    if (dir == nullptr)
+    {
+        return 0;
+    }
+    int node = 0;
+    while (struct dirent *entry = ::readdir(dir))
+    {
+        if (::strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+        {
+            node = ::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    ::closedir(dir);
+    return node;
+}
+
+bool CpuAffinity::bindCurrentThread(int cpu)
+{
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        LOG_ERROR << "CpuAffinity::bindCurrentThread invalid cpu " << cpu;
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (::sched_setaffinity(0, sizeof set, &set) != 0)
+    {
+        LOG_ERROR << "CpuAffinity::bindCurrentThread cpu " << cpu << " errno " << errno;
+        return false;
+    }
+    //线程默认的内存策略就是本地优先,这里显式设置一次,防止进程继承了interleave等策略
+    //之后该线程首次访问的页都分配在这个CPU所在的节点上
+    ::syscall(SYS_set_mempolicy, kMpolLocal, nullptr, 0);
+    return true;
+}
@@ -1,4 +1,5 @@
 #include "ThreadPool.h"
+#include "CpuAffinity.h"
 
 ThreadPool::ThreadPool(const std::string& name)
     :mutex_(),
@@ -24,7 +25,7 @@ void ThreadPool::start(){
     for(int i = 0; i < threadSize_; ++i){
         char id[32];
         snprintf(id, sizeof id, "%d", i+1);
-        threads_.emplace_back(new Thread(std::bind(&ThreadPool::runInThread, this), name_+id));
+        threads_.emplace_back(new Thread(std::bind(&ThreadPool::runInThread, this, i), name_+id));
         //创建线程，线程执行函数为runInThread
         
         //std::bind()将函数绑定到对象上
@@ -53,7 +54,7 @@ size_t ThreadPool::queueSize() const{
     return queue_.size();
 }
 
-void ThreadPool::addTask(ThreadFunction& task){
+void ThreadPool::addTask(Task task){
     if(threads_.empty()){
         task();//直接在主线程中执行
     }
@@ -66,19 +67,22 @@ void ThreadPool::addTask(ThreadFunction& task){
         //区别在于unique_lock可以在构造时加锁，也可以在构造时不加锁，然后在后面的代码中加锁
         //unique_lock可以随时加锁和解锁，lock_guard只能在构造时加锁，析构时解锁
         //unique_lock和condition_variable配合使用时，可以随时加锁和解锁
-        queue_.push_back(task);
+        queue_.push_back(std::move(task));
         cond_.notify_one();
     }
 }
 
 
 //执行任务队列中的任务
-void ThreadPool::runInThread(){
+void ThreadPool::runInThread(int index){
     try{
+        if(!cpus_.empty()){
+            CpuAffinity::bindCurrentThread(cpus_[index % cpus_.size()]);
+        }
         if(threadInitCallback_){//线程初始化回调函数
             threadInitCallback_();
         }
-        ThreadFunction task;
+        Task task;
         while(running_){
             {
                 std::unique_lock<std::mutex> lock(mutex_);
@@ -88,7 +92,7 @@ void ThreadPool::runInThread(){
                     }
                     cond_.wait(lock);//等待任务队列中有任务，或者线程池停止
                 }
-                task = queue_.front();
+                task = std::move(queue_.front());
                 queue_.pop_front();
             }
             if(task!=nullptr){
@@ -1,10 +1,78 @@
 #include "HttpContext.h"
 #include "Buffer.h"
 
+#include <limits>
+
+const size_t HttpContext::kDefaultMaxBodySize;
+const size_t HttpContext::kDefaultStreamThreshold;
+
+namespace
+{
+
+//Transfer-Encoding的最后一个编码必须是chunked,否则无法确定请求体的长度
+bool isChunked(StringPiece value){
+    const char* end = value.end();
+    while(end>value.begin()&&(end[-1]==' '||end[-1]=='\t')){
+        --end;
+    }
+    const char* start = end;
+    while(start>value.begin()&&start[-1]!=','&&start[-1]!=' '&&start[-1]!='\t'){
+        --start;
+    }
+    return StringPiece(start,end-start).equalsIgnoreCase("chunked");
+}
+
+//解析十进制的Content-Length,不允许空值、非数字和溢出
+bool parseDecimal(StringPiece value,size_t* result){
+    if(value.empty()){
+        return false;
+    }
+    size_t n = 0;
+    for(char c : value){
+        if(c<'0'||c>'9'||n>(std::numeric_limits<size_t>::max()-9)/10){
+            return false;
+        }
+        n = n*10+(c-'0');
+    }
+    *result = n;
+    return true;
+}
+
+//解析chunk大小行中的十六进制数,忽略';'之后的chunk扩展
+bool parseChunkSize(const char* begin,const char* end,size_t* result){
+    size_t n = 0;
+    const char* p = begin;
+    for(;p<end;++p){
+        int digit;
+        char c = *p;
+        if(c>='0'&&c<='9'){
+            digit = c-'0';
+        }else if(c>='a'&&c<='f'){
+            digit = c-'a'+10;
+        }else if(c>='A'&&c<='F'){
+            digit = c-'A'+10;
+        }else{
+            break;
+        }
+        if(n>(std::numeric_limits<size_t>::max()>>4)){
+            return false;
+        }
+        n = (n<<4)|digit;
+    }
+    if(p==begin||(p!=end&&*p!=';'&&*p!=' '&&*p!='\t')){
+        return false;
+    }
+    *result = n;
+    return true;
+}
+
+} // namespace
+
 bool HttpContext::processRequestLine(const char *begin,const char *end){
     bool succeed = false;
     const char* start = begin;
-    const char* space = std::find(start, end, ' ');
+    //第一个空格在扫描这一行时已经找到了
+    const char* space = lineScan_.space >= 0 ? begin + lineScan_.space : end;
     if(space!=end&&request_.setMethod(start,space)){
         start = space+1;
         space = std::find(start, end, ' ');
@@ -32,41 +100,187 @@ bool HttpContext::processRequestLine(const char *begin,const char *end){
     return succeed;
 }
 
+bool HttpContext::overLimit(size_t total) const{
+    size_t limit = streaming_ ? maxStreamBodySize_ : maxBodySize_;
+    return limit>0&&total>limit;
+}
+
+bool HttpContext::processHeadersEnd(Buffer *buf){
+    StringPiece encoding = request_.headerView("Transfer-Encoding");
+    if(!encoding.empty()){
+        if(!isChunked(encoding)){
+            error_ = kBadRequest;
+            return false;
+        }
+        //chunked请求体的总长度事先未知,设置了回调就流式接收
+        streaming_ = static_cast<bool>(bodyCallback_);
+        state_ = kExpectChunkSize;
+    }else{
+        StringPiece length = request_.headerView("Content-Length");
+        size_t bodyLength = 0;
+        if(!length.empty()&&!parseDecimal(length,&bodyLength)){
+            error_ = kBadRequest;
+            return false;
+        }
+        streaming_ = bodyCallback_&&bodyLength>streamThreshold_;
+        if(overLimit(bodyLength)){
+            error_ = kBodyTooLarge;
+            return false;
+        }
+        bodyRemaining_ = bodyLength;
+        state_ = bodyLength>0 ? kExpectBody : kGotAll;
+    }
+    if(streaming_){
+        //请求行和头部拷贝一份,之后请求体边到达边从缓冲区中取走,缓冲区不会积压整个请求体
+        request_.ownHead(parsed_);
+        request_.setBodyStreamed(true);
+        buf->retrieve(parsed_);
+        parsed_ = 0;
+    }
+    return true;
+}
+
+bool HttpContext::onBodyData(Buffer *buf,size_t len){
+    bodyReceived_ += len;
+    if(overLimit(bodyReceived_)){
+        error_ = kBodyTooLarge;
+        return false;
+    }
+    const char* data = buf->beginRead()+parsed_;
+    if(streaming_){
+        bodyCallback_(request_,StringPiece(data,len));
+        buf->retrieve(parsed_+len);
+        parsed_ = 0;
+    }else{
+        request_.appendBody(data,len);
+        parsed_ += len;
+    }
+    return true;
+}
+
 bool HttpContext::parseRequest(Buffer *buf, TimeStamp receiveTime){
     bool ok = true;
     bool hasMore = true;
+    //请求在回调返回前一直留在缓冲区中,缓冲区可能已经搬移,先更新请求的起始地址
+    //流式接收请求体时请求行和头部已经拷贝出来了,不再指向缓冲区
+    if(!request_.ownsHead()){
+        request_.setBase(buf->beginRead());
+    }
     while(hasMore){
+        //当前行从请求起始处之后parsed_字节开始
+        const char* line = buf->beginRead()+parsed_;
         if(state_==kExpectRequestLine){
-            const char* crlf = buf->findCRLF();
-            if(crlf){
-                ok = processRequestLine(buf->beginRead(),crlf);
+            //一次扫描同时找出\r\n和第一个空格,没收全时记住进度
+            if(DelimiterScanner::scanLine(line,buf->beginWrite(),&lineScan_)){
+                const char* crlf = line+lineScan_.crlf;
+                ok = processRequestLine(line,crlf);
                 if(ok){
                     request_.setReceiveTime(receiveTime);
-                    buf->retrieveUntil(crlf+2);
+                    parsed_ = crlf+2-buf->beginRead();
+                    lineScan_.reset();
                     state_ = kExpectHeaders;
                 }else{
+                    error_ = kBadRequest;
                     hasMore = false;
                 }
             }else{
                 hasMore = false;
             }
         }else if(state_==kExpectHeaders){
-            const char* crlf = buf->findCRLF();
-            if(crlf){                 
-                const char* colon = std::find(buf->beginRead(),crlf,':');
-                //no matching function for call to ‘find(char*, const char*&, char)’
-                //需要怎么改呢？
-                if(colon!=crlf){
-                    request_.addHeader(buf->beginRead(),colon,crlf);
+            //一次扫描同时找出\r\n和第一个冒号
+            if(DelimiterScanner::scanLine(line,buf->beginWrite(),&lineScan_)){
+                const char* crlf = line+lineScan_.crlf;
+                ssize_t colon = lineScan_.colon;
+                parsed_ = crlf+2-buf->beginRead();
+                lineScan_.reset();
+                if(colon>=0){
+                    request_.addHeader(line,line+colon,crlf);
+                }else{
+                    //空行,头部结束
+                    ok = processHeadersEnd(buf);
+                    hasMore = ok&&state_!=kGotAll;
+                }
+            }else{
+                hasMore = false;
+            }
+        }else if(state_==kExpectBody){
+            size_t avail = buf->readableBytes()-parsed_;
+            if(streaming_){
+                size_t n = std::min(avail,bodyRemaining_);
+                if(n>0){
+                    ok = onBodyData(buf,n);
+                    bodyRemaining_ -= n;
+                }
+            }else if(avail>=bodyRemaining_){
+                //请求体已经完整地在缓冲区中,不用拷贝
+                const char* body = buf->beginRead()+parsed_;
+                request_.setBody(body,body+bodyRemaining_);
+                parsed_ += bodyRemaining_;
+                bodyReceived_ = bodyRemaining_;
+                bodyRemaining_ = 0;
+            }
+            if(ok&&bodyRemaining_==0){
+                state_ = kGotAll;
+            }
+            hasMore = false;
+        }else if(state_==kExpectChunkSize){
+            if(DelimiterScanner::scanLine(line,buf->beginWrite(),&lineScan_)){
+                const char* crlf = line+lineScan_.crlf;
+                size_t chunkSize = 0;
+                if(!parseChunkSize(line,crlf,&chunkSize)){
+                    error_ = kBadRequest;
+                    ok = false;
+                }else if(chunkSize>0&&overLimit(bodyReceived_+chunkSize)){
+                    //数据到达之前就能根据chunk大小拒绝
+                    error_ = kBodyTooLarge;
+                    ok = false;
                 }else{
+                    parsed_ = crlf+2-buf->beginRead();
+                    lineScan_.reset();
+                    bodyRemaining_ = chunkSize;
+                    state_ = chunkSize>0 ? kExpectChunkData : kExpectTrailers;
+                }
+                hasMore = ok;
+            }else{
+                hasMore = false;
+            }
+        }else if(state_==kExpectChunkData){
+            size_t n = std::min(buf->readableBytes()-parsed_,bodyRemaining_);
+            if(n>0){
+                ok = onBodyData(buf,n);
+                bodyRemaining_ -= n;
+            }
+            if(ok&&bodyRemaining_==0){
+                state_ = kExpectChunkEnd;
+            }else{
+                hasMore = false;
+            }
+        }else if(state_==kExpectChunkEnd){
+            if(buf->readableBytes()-parsed_<2){
+                hasMore = false;
+            }else if(line[0]=='\r'&&line[1]=='\n'){
+                parsed_ += 2;
+                state_ = kExpectChunkSize;
+            }else{
+                error_ = kBadRequest;
+                ok = false;
+                hasMore = false;
+            }
+        }else if(state_==kExpectTrailers){
+            //trailer头部直接跳过,遇到空行时请求结束
+            if(DelimiterScanner::scanLine(line,buf->beginWrite(),&lineScan_)){
+                bool last = lineScan_.crlf==0;
+                parsed_ += lineScan_.crlf+2;
+                lineScan_.reset();
+                if(last){
                     state_ = kGotAll;
                     hasMore = false;
                 }
-                buf->retrieveUntil(crlf+2);
             }else{
                 hasMore = false;
             }
-        }else if(state_==kExpectBody){
+        }else{
+            hasMore = false;
         }
     }
     return ok;
@@ -3,25 +3,52 @@
 
 #include "noncopyable.h"
 #include "TimeStamp.h"
+#include "StringPiece.h"
 #include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <ctype.h>
 
+//请求行和头部不再拷贝,只记录它们在连接输入缓冲区中的位置(相对请求起始处的偏移)
+//解析期间缓冲区可能扩容或搬移,所以存偏移而不是指针,访问时加上base_
+//HttpServer在回调返回之前不会从缓冲区中取走这个请求,所以回调中拿到的StringPiece都有效
+//一个带10个头部的普通GET请求解析过程中没有任何堆分配
 class HttpRequest : noncopyable
 {
 public:
     enum Method { kInvalid, kGet, kPost, kHead, kPut, kDelete };
     enum Version { kUnknown, kHttp10, kHttp11 };
 
+    static const size_t kInlineHeaders = 32;//头部数量不超过该值时不分配内存
+
     HttpRequest()
         : method_(kInvalid),
-          version_(kUnknown)
+          version_(kUnknown),
+          base_(NULL),
+          numHeaders_(0),
+          bodyStreamed_(false)
     {
     }
     void setVersion(Version v) { version_ = v; }
-    
+
     Version getVersion() const { return version_; }
 
+    //请求起始处在缓冲区中的地址,每次解析前由HttpContext更新
+    void setBase(const char* base) { base_ = base; }
+
+    //把请求行和头部(共len字节)拷贝到请求自己的存储中,之后不再依赖输入缓冲区
+    //流式接收请求体时调用,这样请求体可以边到达边从缓冲区中取走
+    void ownHead(size_t len)
+    {
+        head_.assign(base_, len);
+        base_ = head_.data();
+    }
+
+    bool ownsHead() const { return base_ != NULL && base_ == head_.data(); }
+
     bool setMethod(const char* start, const char* end){
-        std::string m(start, end);
+        StringPiece m(start, end - start);
         if(m == "GET"){
             method_ = kGet;
         }else if(m == "POST"){
@@ -68,17 +95,23 @@ public:
 
     void setPath(const char* start, const char* end)
     {
-        path_.assign(start, end);
+        path_ = toSlice(start, end);
     }
 
-    const std::string& path() const { return path_; }
+    //零拷贝访问,只在回调返回之前有效
+    StringPiece pathView() const { return toPiece(path_); }
+
+    //拷贝一份,可以在回调返回后继续使用
+    std::string path() const { return pathView().toString(); }
 
     void setQuery(const char* start, const char* end)
     {
-        query_.assign(start, end);
+        query_ = toSlice(start, end);
     }
 
-    const std::string& query() const { return query_; }
+    StringPiece queryView() const { return toPiece(query_); }
+
+    std::string query() const { return queryView().toString(); }
 
     void setReceiveTime(TimeStamp t) { receiveTime_ = t; }
 
@@ -86,52 +119,173 @@ public:
 
     void addHeader(const char* start, const char* colon, const char* end)
     {
-        std::string field(start, colon);
+        const char* field = start;
+        const char* fieldEnd = colon;
         ++colon;
         while (colon < end && isspace(*colon))
         {
             ++colon;
         }
-        std::string value(colon, end);
-        while (!value.empty() && isspace(value[value.size()-1]))
+        while (end > colon && isspace(*(end - 1)))
+        {
+            --end;
+        }
+        HeaderSlot slot = { toSlice(field, fieldEnd), toSlice(colon, end) };
+        if (numHeaders_ < kInlineHeaders)
+        {
+            inlineHeaders_[numHeaders_] = slot;
+        }
+        else
         {
-            value.resize(value.size()-1);
+            extraHeaders_.push_back(slot);
         }
-        headers_[field] = value;
+        ++numHeaders_;
+    }
+
+    size_t headerCount() const { return numHeaders_; }
+    StringPiece headerField(size_t i) const { return toPiece(slotAt(i).field); }
+    StringPiece headerValue(size_t i) const { return toPiece(slotAt(i).value); }
+
+    //字段名不区分大小写,没有该头部时返回空的StringPiece
+    StringPiece headerView(const StringPiece& field) const
+    {
+        for (size_t i = 0; i < numHeaders_; ++i)
+        {
+            const HeaderSlot& slot = slotAt(i);
+            if (toPiece(slot.field).equalsIgnoreCase(field))
+            {
+                return toPiece(slot.value);
+            }
+        }
+        return StringPiece();
     }
 
     std::string getHeader(const std::string& field) const
     {
-        std::string result;
-        std::unordered_map<std::string, std::string>::const_iterator it = headers_.find(field);
-        if (it != headers_.end())
+        return headerView(field).toString();
+    }
+
+    //拷贝出所有头部,同名头部保留最后一个
+    std::unordered_map<std::string, std::string> headers() const
+    {
+        std::unordered_map<std::string, std::string> result;
+        for (size_t i = 0; i < numHeaders_; ++i)
         {
-            result = it->second;
+            result[headerField(i).toString()] = headerValue(i).toString();
         }
         return result;
     }
 
-    const std::unordered_map<std::string, std::string>& headers() const
+    //Content-Length请求体完整地在缓冲区中,只记录位置
+    void setBody(const char* start, const char* end)
+    {
+        bodySlice_ = toSlice(start, end);
+    }
+
+    //chunked请求体被分块编码打断,解码后拷贝到body_中
+    void appendBody(const char* data, size_t len)
     {
-        return headers_;
+        body_.append(data, len);
+    }
+
+    //请求体已经通过流式回调交给了应用,这里不再保存
+    void setBodyStreamed(bool on) { bodyStreamed_ = on; }
+    bool bodyStreamed() const { return bodyStreamed_; }
+
+    StringPiece bodyView() const
+    {
+        return body_.empty() ? toPiece(bodySlice_) : StringPiece(body_);
+    }
+
+    std::string body() const { return bodyView().toString(); }
+
+    void reset()
+    {
+        method_ = kInvalid;
+        version_ = kUnknown;
+        base_ = NULL;
+        path_ = Slice();
+        query_ = Slice();
+        numHeaders_ = 0;
+        extraHeaders_.clear();
+        bodySlice_ = Slice();
+        body_.clear();
+        bodyStreamed_ = false;
+        head_.clear();
+        receiveTime_ = TimeStamp();
     }
 
     void swap(HttpRequest& that)
     {
+        //短字符串存在对象内部,交换后要重新指向各自的head_
+        bool ownsMine = ownsHead();
+        bool ownsTheirs = that.ownsHead();
         std::swap(method_, that.method_);
         std::swap(version_, that.version_);
-        headers_.swap(that.headers_);
-        path_.swap(that.path_);
-        query_.swap(that.query_);
+        std::swap(base_, that.base_);
+        std::swap(path_, that.path_);
+        std::swap(query_, that.query_);
+        std::swap_ranges(inlineHeaders_, inlineHeaders_ + kInlineHeaders, that.inlineHeaders_);
+        extraHeaders_.swap(that.extraHeaders_);
+        std::swap(numHeaders_, that.numHeaders_);
+        std::swap(bodySlice_, that.bodySlice_);
+        body_.swap(that.body_);
+        std::swap(bodyStreamed_, that.bodyStreamed_);
+        head_.swap(that.head_);
+        std::swap(receiveTime_, that.receiveTime_);
+        if (ownsTheirs)
+        {
+            base_ = head_.data();
+        }
+        if (ownsMine)
+        {
+            that.base_ = that.head_.data();
+        }
     }
 private:
+    //相对base_的一段数据
+    struct Slice
+    {
+        Slice() : offset(0), length(0) {}
+        Slice(uint32_t o, uint32_t l) : offset(o), length(l) {}
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct HeaderSlot
+    {
+        Slice field;
+        Slice value;
+    };
+
+    Slice toSlice(const char* start, const char* end) const
+    {
+        return Slice(static_cast<uint32_t>(start - base_), static_cast<uint32_t>(end - start));
+    }
+
+    StringPiece toPiece(const Slice& slice) const
+    {
+        return base_ ? StringPiece(base_ + slice.offset, slice.length) : StringPiece();
+    }
+
+    const HeaderSlot& slotAt(size_t i) const
+    {
+        return i < kInlineHeaders ? inlineHeaders_[i] : extraHeaders_[i - kInlineHeaders];
+    }
+
     Method method_;
     Version version_;
-    std::unordered_map<std::string, std::string> headers_;
-    std::string path_;
-    std::string query_;
-    std::string body_;
+    const char* base_;//请求起始处在输入缓冲区中的地址
+    Slice path_;
+    Slice query_;
+    HeaderSlot inlineHeaders_[kInlineHeaders];
+    std::vector<HeaderSlot> extraHeaders_;//超过kInlineHeaders的头部
+    size_t numHeaders_;
+    Slice bodySlice_;
+    std::string body_;//chunked解码后的请求体
+    bool bodyStreamed_;
+    std::string head_;//ownHead()之后请求行和头部的副本
     TimeStamp receiveTime_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,11 +1,59 @@
 #include "HttpResponse.h"
 #include "Buffer.h"
+#include "OutputQueue.h"
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
-void HttpResponse::appendToBuffer(Buffer* output) const{
-    char buf[32];
+HttpResponse::~HttpResponse(){
+    closeBodyFile();
+}
+
+HttpResponse::HttpResponse(HttpResponse&& other)
+    :headers_(std::move(other.headers_)),
+    statusCode_(other.statusCode_),
+    closeConnection_(other.closeConnection_),
+    statusMessage_(std::move(other.statusMessage_)),
+    body_(std::move(other.body_)),
+    bodyFd_(other.bodyFd_),
+    bodyFileOffset_(other.bodyFileOffset_),
+    bodyFileLength_(other.bodyFileLength_),
+    streamCallback_(std::move(other.streamCallback_)),
+    streamLength_(other.streamLength_),
+    cacheTtl_(other.cacheTtl_){
+    other.bodyFd_ = -1;
+}
+
+HttpResponse& HttpResponse::operator=(HttpResponse&& other){
+    if(this != &other){
+        closeBodyFile();
+        headers_ = std::move(other.headers_);
+        statusCode_ = other.statusCode_;
+        closeConnection_ = other.closeConnection_;
+        statusMessage_ = std::move(other.statusMessage_);
+        body_ = std::move(other.body_);
+        bodyFd_ = other.bodyFd_;
+        bodyFileOffset_ = other.bodyFileOffset_;
+        bodyFileLength_ = other.bodyFileLength_;
+        streamCallback_ = std::move(other.streamCallback_);
+        streamLength_ = other.streamLength_;
+        cacheTtl_ = other.cacheTtl_;
+        other.bodyFd_ = -1;
+    }
+    return *this;
+}
+
+void HttpResponse::closeBodyFile(){
+    if(bodyFd_ >= 0){
+        ::close(bodyFd_);
+        bodyFd_ = -1;
+    }
+}
+
+void HttpResponse::appendHeaders(std::string* output) const{
+    char buf[64];
     memset(buf,'\0',sizeof(buf));
     snprintf(buf,sizeof(buf),"HTTP/1.1 %d ",statusCode_);
     output->append(buf);
@@ -14,8 +62,18 @@ void HttpResponse::appendToBuffer(Buffer* output) const{
     if(closeConnection_){
         output->append("Connection: close\r\n");
     }else{
-        snprintf(buf,sizeof(buf),"Content-Length: %zd\r\n",body_.size());
-        output->append(buf);
+        if(chunked()){
+            output->append("Transfer-Encoding: chunked\r\n");
+        }else{
+            size_t length = body_.size();
+            if(streaming()){
+                length = streamLength_;
+            }else if(bodyFd_ >= 0){
+                length = bodyFileLength_;
+            }
+            snprintf(buf,sizeof(buf),"Content-Length: %zd\r\n",length);
+            output->append(buf);
+        }
         output->append("Connection: Keep-Alive\r\n");
     }
     for(const auto& header:headers_){
@@ -25,8 +83,34 @@ void HttpResponse::appendToBuffer(Buffer* output) const{
         output->append("\r\n");
     }
     output->append("\r\n");
+}
+
+void HttpResponse::appendToBuffer(Buffer* output) const{
+    assert(bodyFd_ < 0);//文件响应体只能由moveToQueue发送,否则只有Content-Length没有内容
+    std::string headers;
+    appendHeaders(&headers);
+    output->append(headers);
     output->append(body_);
 }
 
+void HttpResponse::appendToString(std::string* output) const{
+    assert(bodyFd_ < 0);
+    appendHeaders(output);
+    output->append(body_);
+}
 
-    
\ No newline at end of file
+void HttpResponse::moveToQueue(OutputQueue* output){
+    std::string headers;
+    headers.reserve(256);
+    appendHeaders(&headers);
+    output->append(std::move(headers));
+    if(!body_.empty()){
+        output->append(std::move(body_));
+        body_.clear();
+    }
+    if(bodyFd_ >= 0){
+        //文件区间和响应头放进同一个输出队列,文件内容由sendfile直接发送
+        output->appendFile(bodyFd_,bodyFileOffset_,bodyFileLength_);
+        bodyFd_ = -1;
+    }
+}
@@ -0,0 +1,143 @@
+#include "HttpResponseWriter.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Logging.h"
+
+#include <stdio.h>
+
+HttpResponseWriter::HttpResponseWriter(const TcpConnectionPtr& conn,
+                                       const HttpResponse::StreamCallback& cb,
+                                       bool chunked,
+                                       ssize_t length)
+    :conn_(conn),
+    loop_(conn->getLoop()),
+    streamCallback_(cb),
+    chunked_(chunked),
+    length_(length),
+    bytesWritten_(0),
+    finished_(false),
+    paused_(false){
+}
+
+bool HttpResponseWriter::connected() const{
+    TcpConnectionPtr conn = conn_.lock();
+    return conn && conn->connected();
+}
+
+//检查能否再写len字节,已知长度时不允许超出
+bool HttpResponseWriter::prepare(size_t len){
+    if(finished_){
+        return false;
+    }
+    if(length_ >= 0 && bytesWritten_ + len > static_cast<size_t>(length_)){
+        LOG_ERROR<<"HttpResponseWriter write "<<len<<" bytes beyond Content-Length "<<length_;
+        return false;
+    }
+    return true;
+}
+
+void HttpResponseWriter::sendPiece(OutputQueue* pieces,size_t len){
+    TcpConnectionPtr conn = conn_.lock();
+    if(conn){
+        conn->send(pieces);
+    }
+    bytesWritten_ += len;
+}
+
+bool HttpResponseWriter::write(const char* data,size_t len){
+    if(len == 0){
+        return !finished_;//空chunk表示结束,不能发送
+    }
+    if(!prepare(len)){
+        return false;
+    }
+    OutputQueue pieces;
+    if(chunked_){
+        char size[32];
+        int n = snprintf(size,sizeof(size),"%zx\r\n",len);
+        pieces.append(size,n);
+        pieces.append(data,len);
+        pieces.append("\r\n",2);
+    }else{
+        pieces.append(data,len);
+    }
+    sendPiece(&pieces,len);
+    return connected();
+}
+
+bool HttpResponseWriter::write(std::string&& data){
+    size_t len = data.size();
+    if(len == 0){
+        return !finished_;
+    }
+    if(!prepare(len)){
+        return false;
+    }
+    OutputQueue pieces;
+    if(chunked_){
+        char size[32];
+        int n = snprintf(size,sizeof(size),"%zx\r\n",len);
+        pieces.append(size,n);
+        pieces.append(std::move(data));//大块数据直接转移,不拷贝
+        pieces.append("\r\n",2);
+    }else{
+        pieces.append(std::move(data));
+    }
+    sendPiece(&pieces,len);
+    return connected();
+}
+
+bool HttpResponseWriter::write(const OutputQueue::Block& block){
+    size_t len = block->size();
+    if(len == 0){
+        return !finished_;
+    }
+    if(!prepare(len)){
+        return false;
+    }
+    OutputQueue pieces;
+    if(chunked_){
+        char size[32];
+        int n = snprintf(size,sizeof(size),"%zx\r\n",len);
+        pieces.append(size,n);
+        pieces.append(block);
+        pieces.append("\r\n",2);
+    }else{
+        pieces.append(block);
+    }
+    sendPiece(&pieces,len);
+    return connected();
+}
+
+void HttpResponseWriter::finish(){
+    if(finished_.exchange(true)){
+        return;
+    }
+    if(chunked_){
+        TcpConnectionPtr conn = conn_.lock();
+        if(conn){
+            conn->send(std::string("0\r\n\r\n"));
+        }
+    }
+    if(!complete()){
+        LOG_ERROR<<"HttpResponseWriter finished after "<<bytesWritten_<<" bytes, Content-Length "<<length_;
+    }
+    //放到loop中处理,和之前跨线程发送的数据保持顺序
+    if(finishCallback_){
+        loop_->queueInLoop(finishCallback_);
+    }
+}
+
+void HttpResponseWriter::produce(){
+    if(!finished_ && streamCallback_){
+        streamCallback_(shared_from_this());
+    }
+    if(finished_){
+        streamCallback_ = nullptr;//回调可能持有writer,写完后释放,避免循环引用
+    }
+}
+
+void HttpResponseWriter::abort(){
+    finished_ = true;
+    streamCallback_ = nullptr;
+}
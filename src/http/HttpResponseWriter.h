@@ -0,0 +1,88 @@
+#ifndef HTTP_RESPONSE_WRITER_H
+#define HTTP_RESPONSE_WRITER_H
+
+#include "noncopyable.h"
+#include "Callback.h"
+#include "OutputQueue.h"
+#include "HttpResponse.h"
+
+#include <atomic>
+#include <string>
+
+class EventLoop;
+
+//流式响应体的写入端,响应头已经由HttpServer发出,这里只负责响应体
+//HttpServer在连接可写时调用生产者回调,输出队列积压超过高水位时暂停,写完后继续,
+//几百MB的导出数据不需要整个放进内存
+//write/finish可以在其他线程调用(异步生产者),但同一时刻只能有一个线程写
+class HttpResponseWriter : noncopyable,
+                           public std::enable_shared_from_this<HttpResponseWriter>{
+public:
+    using FinishCallback = std::function<void()>;
+
+    HttpResponseWriter(const TcpConnectionPtr& conn,
+                       const HttpResponse::StreamCallback& cb,
+                       bool chunked,
+                       ssize_t length);
+
+    //写出一段响应体,chunked编码时每次写入成为一个chunk,连接已断开或已经finish时返回false
+    bool write(const char* data,size_t len);
+    bool write(const std::string& data){
+        return write(data.data(),data.size());
+    }
+    bool write(std::string&& data);
+    bool write(const OutputQueue::Block& block);
+
+    //响应体结束,chunked编码时发送最后一个空chunk
+    void finish();
+
+    bool finished() const{
+        return finished_;
+    }
+
+    //输出队列超过高水位后为false,异步生产者应等下一次回调再写
+    bool writable() const{
+        return !paused_ && !finished_ && connected();
+    }
+
+    bool connected() const;
+
+    size_t bytesWritten() const{
+        return bytesWritten_;
+    }
+
+    //已知长度时实际写入的字节数是否和声明的一致,不一致时HttpServer关闭连接
+    bool complete() const{
+        return length_ < 0 || bytesWritten_ == static_cast<size_t>(length_);
+    }
+
+    //以下由HttpServer调用
+    void setFinishCallback(const FinishCallback& cb){
+        finishCallback_ = cb;
+    }
+    void setPaused(bool on){
+        paused_ = on;
+    }
+    //调用一次生产者
+    void produce();
+    //连接断开,丢弃生产者,不再发送
+    void abort();
+
+private:
+    bool prepare(size_t len);
+    void sendPiece(OutputQueue* pieces,size_t len);
+
+    std::weak_ptr<TcpConnection> conn_;
+    EventLoop* loop_;
+    HttpResponse::StreamCallback streamCallback_;
+    FinishCallback finishCallback_;
+    const bool chunked_;
+    const ssize_t length_;//-1表示长度未知
+    std::atomic<size_t> bytesWritten_;
+    std::atomic<bool> finished_;
+    std::atomic<bool> paused_;
+};
+
+using HttpResponseWriterPtr = std::shared_ptr<HttpResponseWriter>;
+
+#endif
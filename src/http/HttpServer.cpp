@@ -2,10 +2,15 @@
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "HttpContext.h"
-
+#include "HttpResponseWriter.h"
+#include "ResponseCache.h"
 
 #include <memory>
 
+const size_t HttpServer::kStreamLowWater;
+const size_t HttpServer::kStreamHighWaterMark;
+const size_t HttpServer::kStreamPumpBytes;
+
 void defaultHttpCallback(const HttpRequest&,HttpResponse* resp){
     resp->setStatusCode(HttpResponse::k404NotFound);
     resp->setStatusMessage("Not Found");
@@ -17,11 +22,54 @@ HttpServer::HttpServer(EventLoop *loop,
                     const std::string &name,
                     TcpServer::Option option)
     :server_(loop,listenAddr,name,option),
-    httpCallback_(defaultHttpCallback){
+    httpCallback_(defaultHttpCallback),
+    streamThreshold_(HttpContext::kDefaultStreamThreshold),
+    maxBodySize_(HttpContext::kDefaultMaxBodySize),
+    maxStreamBodySize_(0),
+    cacheMaxBytes_(0),
+    cacheTtl_(60.0){
         server_.setConnectionCallback(std::bind(&HttpServer::onConnection,this,std::placeholders::_1));
         server_.setMessageCallback(std::bind(&HttpServer::onMessage,this,std::placeholders::_1,std::placeholders::_2,std::placeholders::_3));
+        server_.setThreadInitCallback(std::bind(&HttpServer::onThreadInit,this,std::placeholders::_1));
         server_.setThreadNum(4);
     }
+
+HttpServer::~HttpServer(){
+}
+
+void HttpServer::onThreadInit(EventLoop* loop){
+    if(cacheMaxBytes_ > 0){
+        std::lock_guard<std::mutex> lock(cacheMutex_);
+        caches_[loop].reset(new ResponseCache(cacheMaxBytes_));
+    }
+}
+
+ResponseCache* HttpServer::cacheFor(EventLoop* loop) const{
+    auto it = caches_.find(loop);
+    return it == caches_.end() ? NULL : it->second.get();
+}
+
+void HttpServer::clearResponseCache(){
+    std::lock_guard<std::mutex> lock(cacheMutex_);
+    for(auto& shard : caches_){
+        shard.first->runInLoop(std::bind(&ResponseCache::clear,shard.second.get()));
+    }
+}
+
+void HttpServer::buildCacheKey(const HttpRequest& req,std::string* key) const{
+    key->clear();
+    key->append(req.methodString());
+    key->push_back(' ');
+    StringPiece path = req.pathView();
+    key->append(path.data(),path.size());
+    StringPiece query = req.queryView();
+    key->append(query.data(),query.size());
+    for(const std::string& field : cacheKeyHeaders_){
+        StringPiece value = req.headerView(field);
+        key->push_back('\n');
+        key->append(value.data(),value.size());
+    }
+}
 void HttpServer::start(){
     LOG_INFO<<"HttpServer["<<server_.name()<<"] starts listening on "<<server_.ipPort();
     server_.start();
@@ -30,34 +78,157 @@ void HttpServer::start(){
 void HttpServer::onConnection(const TcpConnectionPtr &conn){
     if(conn->connected()){
         LOG_INFO<<"HttpServer["<<server_.name()<<"] - "<<conn->peerAddress().toIpPort()<<" -> "<<conn->localAddress().toIpPort()<<" is UP";
+        //解析状态保存在连接上,一个请求分多次到达时不会丢失
+        std::shared_ptr<HttpContext> context = std::make_shared<HttpContext>();
+        context->setMaxBodySize(maxBodySize_);
+        context->setMaxStreamBodySize(maxStreamBodySize_);
+        if(bodyCallback_){
+            context->setBodyCallback(bodyCallback_,streamThreshold_);
+        }
+        conn->setContext(context);
+        //流式响应靠这两个回调实现背压
+        conn->setWriteCompleteCallback(std::bind(&HttpServer::onWriteComplete,this,std::placeholders::_1));
+        conn->setHighWaterMarkCallback(std::bind(&HttpServer::onHighWaterMark,this,std::placeholders::_1,std::placeholders::_2),kStreamHighWaterMark);
     }else{
         LOG_INFO<<"HttpServer["<<server_.name()<<"] - "<<conn->peerAddress().toIpPort()<<" -> "<<conn->localAddress().toIpPort()<<" is DOWN";
+        HttpContext* context = conn->getContext<HttpContext>();
+        if(context&&context->responseWriter()){
+            context->responseWriter()->abort();
+            context->setResponseWriter(HttpResponseWriterPtr());
+        }
     }
 }
 
 void HttpServer::onMessage(const TcpConnectionPtr &conn,Buffer *buf,TimeStamp receiveTime){
-    std::unique_ptr<HttpContext> context(new HttpContext);
-    if(!context->parseRequest(buf,receiveTime)){
-        LOG_INFO<<"HttpServer["<<server_.name()<<"] - "<<conn->peerAddress().toIpPort()<<" -> "<<conn->localAddress().toIpPort()<<" is DOWN";
-        conn->send("HTTP/1.1 400 Bad Request\r\n\r\n");
-        conn->shutdown();
+    HttpContext* context = conn->getContext<HttpContext>();
+    if(context->responseWriter()){
+        return;//流式响应还没发完,读取已经暂停,后续请求留在缓冲区中,发完后再处理
     }
-    if(context->gotAll()){
-        LOG_INFO<<"HttpServer["<<server_.name()<<"] - "<<conn->peerAddress().toIpPort()<<" -> "<<conn->localAddress().toIpPort()<<" is DOWN";
-        onRequest(conn,context->request());
+    //一次读到的数据中可能有多个流水线请求,逐个处理,所有响应攒到一起只写一次
+    OutputQueue responses;
+    bool close = false;
+    while(buf->readableBytes() > 0){
+        if(!context->parseRequest(buf,receiveTime)){
+            if(context->error() == HttpContext::kBodyTooLarge){
+                LOG_INFO<<"HttpServer["<<server_.name()<<"] - "<<conn->peerAddress().toIpPort()<<" request body too large";
+                responses.append("HTTP/1.1 413 Payload Too Large\r\nConnection: close\r\n\r\n");
+            }else{
+                LOG_INFO<<"HttpServer["<<server_.name()<<"] - "<<conn->peerAddress().toIpPort()<<" bad request";
+                responses.append("HTTP/1.1 400 Bad Request\r\n\r\n");
+            }
+            buf->retrieveAll();
+            close = true;
+            break;
+        }
+        if(!context->gotAll()){
+            break;//请求还没收全,等下一次数据到达
+        }
+        close = onRequest(conn,context->request(),&responses);
+        //回调已经返回,请求中的StringPiece不再使用,可以从缓冲区中取走
+        buf->retrieve(context->consumedBytes());
         context->reset();
+        if(close){
+            buf->retrieveAll();//之后的请求不再处理
+            break;
+        }
+        if(context->responseWriter()){
+            break;//流式响应发送完之前不处理后续请求
+        }
+    }
+    if(!responses.empty()){
+        conn->send(&responses);
+    }
+    if(context->responseWriter()){
+        pumpResponse(conn);//响应头已经在输出队列中,接着生产响应体,关闭连接推迟到响应体发完
+    }else if(close){
+        conn->shutdown();
     }
 }
 
-void HttpServer::onRequest(const TcpConnectionPtr &conn,const HttpRequest &req){
-    const std::string& connection = req.getHeader("Connection");
-    bool close = connection == "close" || (req.getVersion() == HttpRequest::kHttp10 && connection != "Keep-Alive");
+bool HttpServer::onRequest(const TcpConnectionPtr &conn,const HttpRequest &req,OutputQueue* output){
+    StringPiece connection = req.headerView("Connection");
+    bool close = connection.equalsIgnoreCase("close") || (req.getVersion() == HttpRequest::kHttp10 && !connection.equalsIgnoreCase("Keep-Alive"));
+    ResponseCache* cache = NULL;
+    if(cacheMaxBytes_ > 0 && !close && (req.method() == HttpRequest::kGet || req.method() == HttpRequest::kHead)){
+        cache = cacheFor(conn->getLoop());
+    }
+    if(cache){
+        buildCacheKey(req,cache->keyBuffer());
+        ResponseCache::Block wire = cache->get(*cache->keyBuffer(),req.receiveTime());
+        if(wire){
+            output->append(wire);//命中时不调用回调,直接发送缓存的报文
+            return false;
+        }
+    }
     HttpResponse response(close);
     httpCallback_(req,&response);
-    Buffer buf;
-    response.appendToBuffer(&buf);
-    conn->send(&buf);
-    if(response.closeConnection()){
-        conn->shutdown();
+    if(cache && response.cacheable()){
+        std::shared_ptr<std::string> wire = std::make_shared<std::string>();
+        response.appendToString(wire.get());
+        double ttl = response.cacheTtl() > 0 ? response.cacheTtl() : cacheTtl_;
+        cache->put(*cache->keyBuffer(),wire,addTime(req.receiveTime(),ttl));
+        output->append(ResponseCache::Block(wire));
+        return false;
+    }
+    if(response.streaming() && response.streamLength() < 0 && req.getVersion() == HttpRequest::kHttp10){
+        response.setCloseConnection(true);//HTTP/1.0不支持chunked,以关闭连接表示响应体结束
+    }
+    response.moveToQueue(output);
+    if(response.streaming()){
+        HttpResponseWriterPtr writer = std::make_shared<HttpResponseWriter>(conn,response.streamCallback(),response.chunked(),response.streamLength());
+        writer->setFinishCallback(std::bind(&HttpServer::onStreamFinished,this,std::weak_ptr<TcpConnection>(conn),response.closeConnection()));
+        conn->getContext<HttpContext>()->setResponseWriter(writer);
+        conn->setMigratable(false);//写响应体的回调绑定了当前loop,发完之前不迁移
+        conn->stopRead();//发完之前不处理后续请求,也不再读取,避免对端不收响应却一直发送流水线请求
+    }
+    return response.closeConnection();
+}
+
+void HttpServer::onWriteComplete(const TcpConnectionPtr &conn){
+    HttpContext* context = conn->getContext<HttpContext>();
+    if(context&&context->responseWriter()&&!context->responseWriter()->finished()){
+        context->responseWriter()->setPaused(false);
+        pumpResponse(conn);
+    }
+}
+
+void HttpServer::onHighWaterMark(const TcpConnectionPtr &conn,size_t /*len*/){
+    HttpContext* context = conn->getContext<HttpContext>();
+    if(context&&context->responseWriter()){
+        context->responseWriter()->setPaused(true);
+    }
+}
+
+void HttpServer::pumpResponse(const TcpConnectionPtr &conn){
+    HttpResponseWriterPtr writer = conn->getContext<HttpContext>()->responseWriter();
+    size_t start = writer->bytesWritten();
+    while(!writer->finished() && conn->connected()
+          && conn->outputBytes() < kStreamLowWater
+          && writer->bytesWritten() - start < kStreamPumpBytes){
+        size_t before = writer->bytesWritten();
+        writer->produce();
+        if(writer->bytesWritten() == before){
+            break;//生产者暂时没有数据(异步生产),等它自己写入或下一次写完时再调用
+        }
+    }
+}
+
+void HttpServer::onStreamFinished(const std::weak_ptr<TcpConnection> &weakConn,bool close){
+    TcpConnectionPtr conn = weakConn.lock();
+    if(!conn || !conn->connected()){
+        return;
+    }
+    HttpContext* context = conn->getContext<HttpContext>();
+    HttpResponseWriterPtr writer = context->responseWriter();
+    context->setResponseWriter(HttpResponseWriterPtr());
+    conn->setMigratable(true);
+    conn->startRead();
+    if(close || !writer || !writer->complete()){
+        conn->shutdown();//实际长度和Content-Length不一致时只能关闭连接
+        return;
     }
-}
\ No newline at end of file
+    Buffer* buf = conn->inputBuffer();
+    if(buf->readableBytes() > 0){
+        onMessage(conn,buf,TimeStamp::now());
+    }
+}
@@ -4,19 +4,27 @@
 #include "TcpServer.h"
 #include "noncopyable.h"
 #include "Logging.h"
+#include "HttpContext.h"
 #include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
 
 class HttpRequest;
 class HttpResponse;
+class OutputQueue;
+class ResponseCache;
 
 class HttpServer : noncopyable{
 public:
     using HttpCallback = std::function<void(const HttpRequest&,HttpResponse*)>;
+    using BodyCallback = HttpContext::BodyCallback;
 
     HttpServer(EventLoop* loop,
                 const InetAddress& listenAddr,
                 const std::string& name,
                 TcpServer::Option option = TcpServer::kNoReusePort);
+    ~HttpServer();
 
     EventLoop* getLoop() const{
         return server_.getLoop();
@@ -25,13 +33,76 @@ public:
     void setHttpCallback(const HttpCallback& cb){
         httpCallback_ = cb;
     }
+
+    //大请求体不缓存在内存中,边到达边交给cb,收完之后再调用HttpCallback,此时request.bodyStreamed()为true
+    //Content-Length超过threshold的请求体和所有chunked请求体走这条路径,要在start()之前设置
+    void setBodyCallback(const BodyCallback& cb,size_t threshold = HttpContext::kDefaultStreamThreshold){
+        bodyCallback_ = cb;
+        streamThreshold_ = threshold;
+    }
+    //缓存在内存中的请求体上限,超过时回复413,0表示不限制
+    void setMaxBodySize(size_t bytes){
+        maxBodySize_ = bytes;
+    }
+    //流式接收的请求体上限,默认不限制
+    void setMaxStreamBodySize(size_t bytes){
+        maxStreamBodySize_ = bytes;
+    }
+
+    //开启响应缓存,回调中调用了HttpResponse::setCacheable()的响应会被缓存
+    //每个IO线程一个分片,最多缓存maxBytesPerLoop字节,ttl是setCacheable()没有指定时的有效期,要在start()之前调用
+    void enableResponseCache(size_t maxBytesPerLoop,double ttl = 60.0){
+        cacheMaxBytes_ = maxBytesPerLoop;
+        cacheTtl_ = ttl;
+    }
+    //除了方法和路径之外参与缓存key的请求头部,如Accept-Encoding,要在start()之前设置
+    void setResponseCacheKeyHeaders(const std::vector<std::string>& headers){
+        cacheKeyHeaders_ = headers;
+    }
+    //清空所有分片,可以在任意线程调用
+    void clearResponseCache();
+
+    //keep-alive连接空闲超过seconds秒后关闭,0表示不限制,要在start()之前设置
+    void setIdleTimeout(double seconds){
+        server_.setIdleTimeout(seconds);
+    }
+
     void start();
 private:
+    void onThreadInit(EventLoop* loop);
+    //loop所属的缓存分片,没有开启缓存时返回NULL
+    ResponseCache* cacheFor(EventLoop* loop) const;
+    void buildCacheKey(const HttpRequest& req,std::string* key) const;
     void onConnection(const TcpConnectionPtr& conn);
     void onMessage(const TcpConnectionPtr& conn,Buffer* buf,TimeStamp receiveTime);
-    void onRequest(const TcpConnectionPtr& conn,const HttpRequest& req);
+    //处理一个请求,响应追加到output中,返回是否需要关闭连接
+    //流式响应只追加响应头,响应体由HttpResponseWriter随后发送
+    bool onRequest(const TcpConnectionPtr& conn,const HttpRequest& req,OutputQueue* output);
+    //输出队列写空后继续生产流式响应体
+    void onWriteComplete(const TcpConnectionPtr& conn);
+    //输出队列积压过多,暂停流式响应
+    void onHighWaterMark(const TcpConnectionPtr& conn,size_t len);
+    //在输出队列低于低水位时调用生产者,每次最多生产kStreamPumpBytes字节,剩下的等写完后继续
+    void pumpResponse(const TcpConnectionPtr& conn);
+    //流式响应发送完毕,继续处理缓冲区中等待的请求
+    void onStreamFinished(const std::weak_ptr<TcpConnection>& weakConn,bool close);
+
+    static const size_t kStreamLowWater = 256 * 1024;
+    static const size_t kStreamHighWaterMark = 4 * 1024 * 1024;
+    static const size_t kStreamPumpBytes = 1024 * 1024;
+
     TcpServer server_;
     HttpCallback httpCallback_;
+    BodyCallback bodyCallback_;
+    size_t streamThreshold_;
+    size_t maxBodySize_;
+    size_t maxStreamBodySize_;
+
+    size_t cacheMaxBytes_;//0表示不缓存
+    double cacheTtl_;
+    std::vector<std::string> cacheKeyHeaders_;
+    std::mutex cacheMutex_;//只在IO线程启动、创建分片时使用,之后caches_只读
+    std::unordered_map<EventLoop*,std::unique_ptr<ResponseCache>> caches_;
 };
 
 
@@ -0,0 +1,48 @@
+#include "ResponseCache.h"
+
+ResponseCache::Block ResponseCache::get(const std::string& key,TimeStamp now){
+    auto it = index_.find(key);
+    if(it == index_.end()){
+        ++misses_;
+        return Block();
+    }
+    EntryList::iterator entry = it->second;
+    if(entry->expiration < now){
+        //过期的条目在查找时顺便删除
+        erase(entry);
+        ++misses_;
+        return Block();
+    }
+    lru_.splice(lru_.begin(),lru_,entry);
+    ++hits_;
+    return entry->wire;
+}
+
+void ResponseCache::put(const std::string& key,const Block& wire,TimeStamp expiration){
+    auto it = index_.find(key);
+    if(it != index_.end()){
+        erase(it->second);
+    }
+    size_t size = key.size() + wire->size();
+    if(size > maxBytes_){
+        return;//单个响应比整个缓存还大,不缓存
+    }
+    while(bytes_ + size > maxBytes_ && !lru_.empty()){
+        erase(std::prev(lru_.end()));
+    }
+    lru_.push_front(Entry{key,wire,expiration});
+    index_[key] = lru_.begin();
+    bytes_ += size;
+}
+
+void ResponseCache::clear(){
+    lru_.clear();
+    index_.clear();
+    bytes_ = 0;
+}
+
+void ResponseCache::erase(EntryList::iterator it){
+    bytes_ -= entryBytes(*it);
+    index_.erase(it->key);
+    lru_.erase(it);
+}
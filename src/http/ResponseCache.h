@@ -0,0 +1,78 @@
+#ifndef HTTP_RESPONSE_CACHE_H
+#define HTTP_RESPONSE_CACHE_H
+
+#include "noncopyable.h"
+#include "OutputQueue.h"
+#include "TimeStamp.h"
+
+#include <list>
+#include <string>
+#include <unordered_map>
+
+//序列化好的完整响应(状态行+头部+响应体)的LRU缓存
+//每个EventLoop一个分片,只在所属的loop线程中访问,不加锁
+//缓存的数据是不可变的共享块,命中时直接放进连接的输出队列,不拷贝
+class ResponseCache : noncopyable{
+public:
+    using Block = OutputQueue::Block;
+
+    explicit ResponseCache(size_t maxBytes)
+        :maxBytes_(maxBytes),
+        bytes_(0),
+        hits_(0),
+        misses_(0){
+    }
+
+    //查找key对应的响应,不存在或已过期时返回空,命中的条目移到LRU头部
+    Block get(const std::string& key,TimeStamp now);
+
+    //插入或替换,总大小超过maxBytes_时淘汰最久未使用的条目
+    void put(const std::string& key,const Block& wire,TimeStamp expiration);
+
+    void clear();
+
+    size_t size() const{
+        return index_.size();
+    }
+
+    size_t bytes() const{
+        return bytes_;
+    }
+
+    size_t hits() const{
+        return hits_;
+    }
+
+    size_t misses() const{
+        return misses_;
+    }
+
+    //拼接缓存key用的临时字符串,复用容量,查找时不分配内存
+    std::string* keyBuffer(){
+        return &keyBuffer_;
+    }
+
+private:
+    struct Entry{
+        std::string key;
+        Block wire;
+        TimeStamp expiration;
+    };
+    using EntryList = std::list<Entry>;
+
+    void erase(EntryList::iterator it);
+
+    static size_t entryBytes(const Entry& entry){
+        return entry.key.size() + entry.wire->size();
+    }
+
+    size_t maxBytes_;
+    size_t bytes_;//所有条目key和响应的总字节数
+    size_t hits_;
+    size_t misses_;
+    EntryList lru_;//头部是最近使用的
+    std::unordered_map<std::string,EntryList::iterator> index_;
+    std::string keyBuffer_;
+};
+
+#endif
@@ -1,12 +1,20 @@
 #include "InetAddress.h"
 #include "Acceptor.h"
+#include "EventLoop.h"
 #include "Logging.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <algorithm>
 #include <functional>
 
+static const double kMinAcceptBackoff = 0.01;//秒
+static const double kMaxAcceptBackoff = 1.0;
+
 //创建非阻塞套接字,并设置SO_REUSEADDR和SO_REUSEPORT选项,并绑定地址
 static int createNonblocking(){
     int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
@@ -22,7 +30,13 @@ Acceptor::Acceptor(EventLoop* loop, const InetAddress& listenAddr, bool reusepor
     : loop_(loop),
       acceptSocket_(createNonblocking()),
         acceptChannel_(loop, acceptSocket_.fd()),
-        listenning_(false)
+        listenning_(false),
+        maxAcceptsPerRead_(64),
+        idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+        backoff_(kMinAcceptBackoff),
+        paused_(false),
+        rejectedConnections_(0),
+        alive_(new char(0))
 {
     LOG_DEBUG << "Acceptor::Acceptor [fd=" << acceptSocket_.fd() << "]";
 
@@ -37,6 +51,10 @@ Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll();
     acceptChannel_.remove();
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
 }
 
 void Acceptor::listen()
@@ -47,30 +65,97 @@ void Acceptor::listen()
     acceptChannel_.enableReading();
 }
 
+InetAddress Acceptor::listenAddress() const
+{
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    socklen_t addrlen = sizeof(addr);
+    if (::getsockname(acceptSocket_.fd(), (sockaddr *)&addr, &addrlen) < 0)
+    {
+        LOG_ERROR << "Acceptor::listenAddress";
+    }
+    return InetAddress(addr);
+}
+
 void Acceptor::handleRead()
 {
-    
-    InetAddress peerAddr;
-    int connfd = acceptSocket_.accept(&peerAddr);
-    //peerAddr是对端地址
-    if (connfd >= 0)
+    //连接风暴时一次唤醒处理多个连接,减少epoll_wait的次数
+    for (int i = 0; i < maxAcceptsPerRead_; ++i)
     {
-        if (newConnectionCallback_)
+        InetAddress peerAddr;
+        int connfd = acceptSocket_.accept(&peerAddr);
+        //peerAddr是对端地址
+        if (connfd >= 0)
+        {
+            backoff_ = kMinAcceptBackoff;
+            if (newConnectionCallback_)
+            {
+                newConnectionCallback_(connfd, peerAddr);
+            }
+            else
+            {   LOG_DEBUG << "in Acceptor::handleRead";
+                ::close(connfd);
+            }
+        }
+        else if (errno == EINTR || errno == ECONNABORTED)
         {
-            newConnectionCallback_(connfd, peerAddr);
+            continue;//对端在accept之前断开,继续取下一个
+        }
+        else if (errno == EMFILE || errno == ENFILE)//文件描述符用完了
+        {
+            LOG_ERROR << "Acceptor::handleRead EMFILE";
+            handleFdExhausted();
+            break;
         }
         else
-        {   LOG_DEBUG << "in Acceptor::handleRead";
-            ::close(connfd);
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                LOG_ERROR << "in Acceptor::handleRead";
+            }
+            break;
         }
     }
-    else
+}
+
+void Acceptor::handleFdExhausted()
+{
+    //关掉预留fd腾出一个位置,接受队首的连接后马上关闭,让对端尽快知道连接被拒绝
+    if (idleFd_ >= 0)
     {
-        LOG_ERROR << "in Acceptor::handleRead";
-        if(errno == EMFILE){//文件描述符用完了
-            LOG_ERROR << "Acceptor::handleRead EMFILE";
-            
+        ::close(idleFd_);
+        int connfd = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+        if (connfd >= 0)
+        {
+            ::close(connfd);
+            rejectedConnections_.fetch_add(1, std::memory_order_relaxed);
         }
+        idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    //队列中可能还有连接,暂停一段时间再accept,避免水平触发让loop空转
+    if (!paused_)
+    {
+        paused_ = true;
+        acceptChannel_.disableReading();
+        std::weak_ptr<char> alive(alive_);
+        loop_->runAfter(backoff_, [this, alive]() {
+            if (alive.lock())
+            {
+                resumeAccept();
+            }
+        });
+        LOG_WARN << "Acceptor pauses accepting for " << backoff_ << "s, rejected "
+                 << rejectedConnections_.load(std::memory_order_relaxed) << " connections";
+        backoff_ = std::min(backoff_ * 2, kMaxAcceptBackoff);
+    }
+}
+
+void Acceptor::resumeAccept()
+{
+    paused_ = false;
+    if (listenning_)
+    {
+        acceptChannel_.enableReading();
     }
 }
 
@@ -4,6 +4,10 @@
 #include "noncopyable.h"
 #include "Channel.h"
 #include "Socket.h"
+#include "InetAddress.h"
+
+#include <atomic>
+#include <memory>
 
 class EventLoop;
 class InetAddress;
@@ -20,14 +24,33 @@ public:
 
     bool listenning() const { return listenning_; }
     void listen();//开始监听
+
+    EventLoop* getLoop() const { return loop_; }
+
+    //每次可读事件最多accept的连接数,一直accept到EAGAIN或者达到上限,剩下的下一轮继续(水平触发)
+    void setMaxAcceptsPerRead(int n) { maxAcceptsPerRead_ = n; }
+
+    //监听套接字实际绑定的地址(端口为0时由内核分配)
+    InetAddress listenAddress() const;
+
+    //文件描述符耗尽时被直接关闭的连接数,可以在任意线程读取
+    uint64_t rejectedConnections() const { return rejectedConnections_.load(std::memory_order_relaxed); }
 private:
     void handleRead();//处理读事件
+    void handleFdExhausted();//EMFILE/ENFILE时腾出预留fd接受并关闭一个连接,然后暂停accept
+    void resumeAccept();
 
     EventLoop* loop_;//所属的EventLoop
     Socket acceptSocket_;//监听套接字
     Channel acceptChannel_;//监听套接字对应的Channel
     NewConnectionCallback newConnectionCallback_;//新连接回调函数
     bool listenning_;//是否正在监听
+    int maxAcceptsPerRead_;
+    int idleFd_;//预留的fd,描述符耗尽时关掉它来accept并关闭一个连接,否则水平触发的监听套接字会让loop空转
+    double backoff_;//暂停accept的时间,连续耗尽时加倍
+    bool paused_;
+    std::atomic<uint64_t> rejectedConnections_;
+    std::shared_ptr<char> alive_;//定时器通过weak_ptr判断Acceptor是否已经析构
 };
 
 
@@ -1,13 +1,122 @@
 #include "Buffer.h"
+#include "ChunkPool.h"
+#include "BufferBudget.h"
+#include "DelimiterScanner.h"
+
+#include <errno.h>
+#include <algorithm>
 
 
 //\n 是Windows下的换行符，\r\n是Linux下的换行符
 const char Buffer::kCRLF[] = "\r\n";
+char Buffer::kEmptyStorage[Buffer::kCheapPrepend];
+const size_t Buffer::kDefaultShrinkThreshold;
+
+Buffer::~Buffer(){
+    if(chunk_){
+        pool_->deallocate(chunk_);
+    }
+    setBudget(nullptr);
+}
+
+void Buffer::setBudget(BufferBudget* budget){
+    if(budget_){
+        budget_->addReserved(-static_cast<int64_t>(reservedReported_));
+        budget_->addUsed(-static_cast<int64_t>(usedReported_));
+    }
+    budget_ = budget;
+    usedReported_ = readableBytes();
+    if(budget_){
+        budget_->addReserved(reservedReported_);
+        budget_->addUsed(usedReported_);
+    }
+}
+
+void Buffer::reportUsage(){
+    size_t used = readableBytes();
+    if(budget_ && used != usedReported_){
+        budget_->addUsed(static_cast<int64_t>(used) - static_cast<int64_t>(usedReported_));
+    }
+    usedReported_ = used;
+}
+
+void Buffer::resetStorage(){
+    if(chunk_){
+        data_ = chunk_;
+        capacity_ = ChunkPool::kChunkSize;
+    }else if(!buffer_.empty()){
+        data_ = &*buffer_.begin();
+        capacity_ = buffer_.size();
+    }else{
+        data_ = kEmptyStorage;
+        capacity_ = kCheapPrepend;
+    }
+    //std::vector::resize不会缩小capacity,按实际申请的大小统计
+    size_t reserved = chunk_ ? ChunkPool::kChunkSize : buffer_.capacity();
+    if(budget_ && reserved != reservedReported_){
+        budget_->addReserved(static_cast<int64_t>(reserved) - static_cast<int64_t>(reservedReported_));
+    }
+    reservedReported_ = reserved;
+}
+
+void Buffer::releaseIdleStorage(){
+    reportUsage();
+    if(pool_ && readableBytes() == 0 && capacity_ != kCheapPrepend){
+        shrink(0);
+    }
+}
+
+void Buffer::setPool(ChunkPool* pool){
+    if(pool == pool_){
+        return;
+    }
+    if(chunk_){
+        size_t readable = readableBytes();
+        std::vector<char> buf(kCheapPrepend + readable);
+        std::copy(beginRead(), beginRead() + readable, buf.begin() + kCheapPrepend);
+        buf.swap(buffer_);
+        pool_->deallocate(chunk_);
+        chunk_ = nullptr;
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend + readable;
+        resetStorage();
+    }
+    pool_ = pool;
+}
+
+void Buffer::shrink(size_t reserve){
+    size_t readable = readableBytes();
+    if(pool_ && readable == 0){
+        //读空了,内存块和buffer_都不再保留,下次读数据时再借
+        if(chunk_){
+            pool_->deallocate(chunk_);
+            chunk_ = nullptr;
+        }
+        std::vector<char>().swap(buffer_);
+    }else if(!chunk_){
+        //内存块大小固定,不需要收缩;buffer_按需重新申请,swap后旧的存储被释放
+        std::vector<char> buf(kCheapPrepend + readable + reserve);
+        std::copy(beginRead(), beginRead() + readable, buf.begin() + kCheapPrepend);
+        buf.swap(buffer_);
+    }else{
+        return;
+    }
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = kCheapPrepend + readable;
+    resetStorage();
+    reportUsage();
+}
 
 
 void Buffer::retrieveAll(){
     readerIndex_ = kCheapPrepend;
     writerIndex_ = kCheapPrepend;
+    //高水位收缩:一次大数据读空后不再一直占着大块存储
+    if(!chunk_ && capacity_ > kCheapPrepend + kInitialSize
+        && ((shrinkThreshold_ > 0 && capacity_ > shrinkThreshold_)
+            || (budget_ && budget_->overBudget()))){
+        shrink(pool_ ? 0 : kInitialSize);
+    }
 }
 
 void Buffer::retrieve(size_t len){
@@ -55,24 +164,45 @@ void Buffer::append(const char* data, size_t len){
 }
 
 const char* Buffer::findCRLF() const{
-    const char* crlf = std::search(beginRead(), beginWrite(), kCRLF, kCRLF+2);
-    return crlf == beginWrite() ? NULL : crlf;
+    return DelimiterScanner::findCRLF(beginRead(), beginWrite());
 }
 
-ssize_t Buffer::readFd(int fd, int* savedErrno){
-    char extrabuf[65536] = {0};//二级缓冲区
+const char* Buffer::findCRLF(const char* start) const{
+    assert(beginRead() <= start);
+    assert(start <= beginWrite());
+    return DelimiterScanner::findCRLF(start, beginWrite());
+}
+
+ssize_t Buffer::readFd(int fd, int* savedErrno, size_t maxBytes){
+    char stackbuf[65536];//没有ChunkPool时使用的二级缓冲区,不做零初始化
+    char* extrabuf = stackbuf;
+    size_t extraSize = sizeof(stackbuf);
+    if(pool_){
+        if(capacity_ == kCheapPrepend){
+            //没有任何存储,先借一个内存块,数据直接读进这个块
+            makeSpace(1);
+        }
+        //二级缓冲区也从池中借,读完马上归还
+        extrabuf = pool_->allocate();
+        extraSize = ChunkPool::kChunkSize;
+    }
     struct iovec vec[2];
     //struct iovec {
     //    void  *iov_base;    /*首地址*/
     //    size_t iov_len;     /*长度*/
     //};
-    const size_t writable = writableBytes();
+    size_t writable = writableBytes();
+    if(maxBytes > 0){
+        //限制两段的总长度不超过maxBytes
+        writable = std::min(writable, maxBytes);
+        extraSize = std::min(extraSize, maxBytes - writable);
+    }
     vec[0].iov_base = beginWrite();
     vec[0].iov_len = writable;
     vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof(extrabuf);
-    const int iovcnt = (writable < sizeof(extrabuf)) ? 2 : 1;
-    //buffer_小于64k，使用二级缓冲区，否则直接使用buffer_
+    vec[1].iov_len = extraSize;
+    const int iovcnt = (writable < extraSize) ? 2 : 1;
+    //可写空间小于二级缓冲区时，使用二级缓冲区，否则直接使用buffer_
     const ssize_t n = ::readv(fd, vec, iovcnt);
     //readv优先将数据读到buffer_中，如果buffer_不够，再读到extrabuf中
     //n < 0 读取失败, n == 0 读取到文件末尾, n > 0 读取到数据
@@ -82,9 +212,13 @@ ssize_t Buffer::readFd(int fd, int* savedErrno){
     }else if(static_cast<size_t>(n) <= writable){
         writerIndex_ += n;
     }else{
-        writerIndex_ = buffer_.size();
+        writerIndex_ = capacity_;
         append(extrabuf, n - writable);
     }
+    if(pool_){
+        pool_->deallocate(extrabuf);
+    }
+    reportUsage();
     return n;
 }
 
@@ -102,9 +236,21 @@ ssize_t Buffer::writeFd(int fd, int* savedErrno){
 
 
 void Buffer::makeSpace(size_t len){
-    //如果buffer_的可写空间不够，且可读空间加上可写空间不够len，那么就resize
+    //如果buffer_的可写空间不够，且可读空间加上可写空间不够len，那么就扩容
     if(writableBytes() + prependableBytes() < len + kCheapPrepend){
-        buffer_.resize(writerIndex_ + len);
+        if(pool_ && capacity_ == kCheapPrepend && writerIndex_ + len <= ChunkPool::kChunkSize){
+            //还没有存储且一个内存块放得下,从池中借一个块
+            chunk_ = pool_->allocate();
+        }else if(chunk_){
+            //一个内存块放不下了,把数据搬到buffer_中并归还内存块
+            buffer_.resize(writerIndex_ + len);
+            std::copy(chunk_ + readerIndex_, chunk_ + writerIndex_, buffer_.begin() + readerIndex_);
+            pool_->deallocate(chunk_);
+            chunk_ = nullptr;
+        }else{
+            buffer_.resize(writerIndex_ + len);
+        }
+        resetStorage();
     }else{
         assert(kCheapPrepend < readerIndex_);
         //将可读数据移到buffer_的前面
@@ -9,28 +9,69 @@
 #include <sys/uio.h>
 #include <unistd.h>
 
-class Buffer {
+#include "noncopyable.h"
+
+class ChunkPool;
+class BufferBudget;
+
+//存储有两种来源:
+//  默认构造时使用自己的std::vector<char>
+//  传入ChunkPool时,小于一个内存块的数据存放在从池中借来的内存块中,
+//  超过一个块时才换成std::vector<char>,数据读空后可以通过releaseIdleStorage把存储全部还回去
+//回收策略:
+//  retrieveAll之后存储超过shrinkThreshold_(高水位)时收缩
+//  所属的BufferBudget超出预算时,retrieveAll之后总是收缩
+class Buffer : noncopyable {
 public:
     static const size_t kCheapPrepend = 8;
     //预留8个字节，用于存放一些辅助信息
     static const size_t kInitialSize = 1024;
     //初始化时的缓冲区大小
+    static const size_t kDefaultShrinkThreshold = 1024 * 1024;
+    //默认的收缩高水位,读空后存储超过1MB就收缩
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize),//buffer_的大小为kCheapPrepend+initialSize
+        : pool_(nullptr),
+          chunk_(nullptr),
+          buffer_(kCheapPrepend + initialSize),//buffer_的大小为kCheapPrepend+initialSize
           readerIndex_(kCheapPrepend),//读指针的初始位置为kCheapPrepend
-          writerIndex_(kCheapPrepend)//写指针的初始位置为kCheapPrepend
+          writerIndex_(kCheapPrepend),//写指针的初始位置为kCheapPrepend
+          budget_(nullptr),
+          reservedReported_(0),
+          usedReported_(0),
+          shrinkThreshold_(kDefaultShrinkThreshold)
     {
+        resetStorage();
         assert(readableBytes() == 0);
         assert(writableBytes() == initialSize);
         assert(prependableBytes() == kCheapPrepend);
     }
 
+    //从pool中借用内存块,构造时不分配内存,第一次写入时才借用
+    explicit Buffer(ChunkPool* pool)
+        : pool_(pool),
+          chunk_(nullptr),
+          readerIndex_(kCheapPrepend),
+          writerIndex_(kCheapPrepend),
+          budget_(nullptr),
+          reservedReported_(0),
+          usedReported_(0),
+          shrinkThreshold_(kDefaultShrinkThreshold)
+    {
+        resetStorage();
+        assert(writableBytes() == 0);
+    }
+
+    ~Buffer();
+
     size_t readableBytes() const { return writerIndex_ - readerIndex_; }
 
-    size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+    size_t writableBytes() const { return capacity_ - writerIndex_; }
 
     size_t prependableBytes() const { return readerIndex_;}
 
+    //当前占用的存储大小
+    size_t internalCapacity() const { return reservedReported_; }
+
 
     //实现两个版本，一个是const，一个是非const，这样可以在const对象上调用，也可以在非const对象上调用。
     //返回可读数据的首地址
@@ -70,22 +111,55 @@ public:
     //写data数据，长度为len
     void append(const char* data, size_t len);
 
-    //寻找\r\n，返回\r\n的地址，用于查找一行数据
+    //寻找\r\n，返回\r\n的地址，用于查找一行数据,使用SIMD扫描
     const char* findCRLF() const;
 
-    ssize_t readFd(int fd, int* savedErrno);
+    //从start开始寻找\r\n
+    const char* findCRLF(const char* start) const;
+
+    //maxBytes不为0时本次最多读maxBytes字节,剩下的留在socket中
+    ssize_t readFd(int fd, int* savedErrno, size_t maxBytes = 0);
 
     ssize_t writeFd(int fd, int* savedErrno);
 
+    //刷新预算中的使用量;使用ChunkPool且没有数据时,把内存块和buffer_全部还回去
+    void releaseIdleStorage();
+
+    //只保留可读数据和reserve字节的可写空间,使用ChunkPool且没有数据时释放全部存储
+    void shrink(size_t reserve);
+
+    //把占用和使用量统计到budget中,传入nullptr取消统计
+    void setBudget(BufferBudget* budget);
+
+    //改为从pool借用内存块,当前借用的内存块先还给原来的池,数据搬到buffer_中
+    //需要在原来的池所属的线程中调用
+    void setPool(ChunkPool* pool);
+
+    //读空后存储超过threshold就收缩,0表示不收缩
+    void setShrinkThreshold(size_t threshold) { shrinkThreshold_ = threshold; }
+
 private:
     void makeSpace(size_t len);
-    char* begin() { return &*buffer_.begin(); }
-    //begin是迭代器，先解引用，再取地址才是指针
-    const char* begin() const { return &*buffer_.begin(); }
+    //存储改变后更新data_和capacity_
+    void resetStorage();
+    //把可读数据量的变化同步到budget_
+    void reportUsage();
+    char* begin() { return data_; }
+    const char* begin() const { return data_; }
+
+    ChunkPool* pool_;//为空时只使用buffer_
+    char* chunk_;//从pool_借用的内存块
     std::vector<char> buffer_;
+    char* data_;//当前存储的首地址,指向chunk_、buffer_或者kEmptyStorage
+    size_t capacity_;//当前存储的大小
     size_t readerIndex_;
     size_t writerIndex_;
+    BufferBudget* budget_;//内存统计,可以为空
+    size_t reservedReported_;//已经统计到budget_中的存储大小
+    size_t usedReported_;//已经统计到budget_中的可读数据量
+    size_t shrinkThreshold_;//收缩高水位
     static const char kCRLF[];//用于表示换行符
+    static char kEmptyStorage[kCheapPrepend];//没有任何存储时的占位,保证begin()始终有效
 };
 
 
@@ -0,0 +1,45 @@
+#ifndef BUFFER_BUDGET_H
+#define BUFFER_BUDGET_H
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+//一组Buffer(通常是一个TcpServer的所有连接)共享的内存统计和预算
+//reserved是各Buffer占用的存储大小,used是其中尚未读取的数据量
+//多个IO线程会同时更新,所以使用原子变量;只在存储改变或一次读写结束时更新,不在热路径上
+class BufferBudget : noncopyable {
+public:
+    explicit BufferBudget(size_t limit = 0)
+        : limit_(limit),
+          reserved_(0),
+          used_(0)
+    {
+    }
+
+    void addReserved(int64_t delta) { reserved_.fetch_add(delta, std::memory_order_relaxed); }
+    void addUsed(int64_t delta) { used_.fetch_add(delta, std::memory_order_relaxed); }
+
+    size_t reservedBytes() const { return static_cast<size_t>(reserved_.load(std::memory_order_relaxed)); }
+    size_t usedBytes() const { return static_cast<size_t>(used_.load(std::memory_order_relaxed)); }
+
+    //预算上限,0表示不限制
+    void setLimit(size_t limit) { limit_ = limit; }
+    size_t limit() const { return limit_; }
+
+    //超出预算时Buffer读空后会立即归还所有多余的存储
+    bool overBudget() const
+    {
+        size_t limit = limit_;
+        return limit > 0 && reservedBytes() > limit;
+    }
+
+private:
+    std::atomic<size_t> limit_;
+    std::atomic<int64_t> reserved_;
+    std::atomic<int64_t> used_;
+};
+
+#endif
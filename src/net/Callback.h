@@ -6,11 +6,14 @@
 
 class Buffer;
 class TcpConnection;
+class EventLoop;
 class TimeStamp;
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;
+//连接迁移到新loop后在新loop中调用,from为原来的loop
+using MigrateCallback = std::function<void(const TcpConnectionPtr&, EventLoop* from)>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t)>;
 
 using MessageCallback = std::function<void(const TcpConnectionPtr&, Buffer*, TimeStamp)>;
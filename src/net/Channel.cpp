@@ -16,6 +16,10 @@ Channel::Channel(EventLoop* loop,int fd)
     events_(0),
     revents_(0),
     index_(-1),
+    edgeTriggered_(false),
+    keepWriteArmed_(false),
+    registeredEvents_(0),
+    updatePending_(false),
     tied_(false)
 {
 }
@@ -55,9 +55,23 @@ public:
     bool isWriting() const { return events_ & kWriteEvent; }//是否是写事件
     bool isReading() const { return events_ & kReadEvent; }//是否是读事件
 
+    //边沿触发(EPOLLET),需在第一次enableReading之前设置
+    //回调必须把数据读写到EAGAIN为止,否则剩下的数据不会再通知
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    bool isEdgeTriggered() const { return edgeTriggered_; }
+
+    //边沿触发时一直在epoll中保留EPOLLOUT,enableWriting/disableWriting只改变是否处理可写事件,不再需要epoll_ctl
+    void setKeepWriteArmed(bool on) { keepWriteArmed_ = on; }
+    bool keepWriteArmed() const { return edgeTriggered_ && keepWriteArmed_; }
+
     int index() { return index_; }//返回在Poller中的索引
     void set_index(int idx) { index_ = idx; }//设置在Poller中的索引
 
+    int registeredEvents() const { return registeredEvents_; }//epoll中实际注册的事件
+    void set_registeredEvents(int events) { registeredEvents_ = events; }
+    bool updatePending() const { return updatePending_; }//是否有等待提交给epoll的修改
+    void set_updatePending(bool on) { updatePending_ = on; }
+
     EventLoop* ownerLoop() { return loop_; }//返回所属的EventLoop
     void remove();//移除Channel
 
@@ -74,6 +88,10 @@ private:
     int events_;//关注的事件
     int revents_;//返回的事件
     int index_;//在Poller中的索引
+    bool edgeTriggered_;//是否使用边沿触发
+    bool keepWriteArmed_;
+    int registeredEvents_;
+    bool updatePending_;
 
     std::weak_ptr<void> tie_;//tie_是一个弱引用，它指向一个对象，该对象的生命周期由tie_管理
     bool tied_;//tie_是否有效
@@ -0,0 +1,51 @@
+#include "ChunkPool.h"
+
+#include <algorithm>
+#include <assert.h>
+
+const size_t ChunkPool::kChunkSize;
+const size_t ChunkPool::kDefaultMaxIdleChunks;
+
+ChunkPool::~ChunkPool(){
+    shrink();
+}
+
+char* ChunkPool::allocate(){
+    ++chunksInUse_;
+    if(freeList_.empty()){
+        return new char[kChunkSize];//不做零初始化
+    }
+    char* chunk = freeList_.back();
+    freeList_.pop_back();
+    lowWater_ = std::min(lowWater_, freeList_.size());
+    return chunk;
+}
+
+void ChunkPool::deallocate(char* chunk){
+    assert(chunksInUse_ > 0);
+    --chunksInUse_;
+    if(freeList_.size() < maxIdleChunks_){
+        freeList_.push_back(chunk);
+    }else{
+        delete[] chunk;
+    }
+}
+
+void ChunkPool::shrink(){
+    for(char* chunk : freeList_){
+        delete[] chunk;
+    }
+    freeList_.clear();
+    freeList_.shrink_to_fit();
+    lowWater_ = 0;
+}
+
+void ChunkPool::trim(){
+    //低水位以下的空闲块在整个周期内都没被借出过,说明是多余的
+    size_t excess = std::min(lowWater_, freeList_.size());
+    for(size_t i = 0; i < excess; ++i){
+        delete[] freeList_.back();
+        freeList_.pop_back();
+    }
+    lowWater_ = freeList_.size();
+}
@@ -0,0 +1,49 @@
+#ifndef CHUNK_POOL_H
+#define CHUNK_POOL_H
+
+#include "noncopyable.h"
+
+#include <vector>
+#include <stddef.h>
+
+//定长内存块池,每个EventLoop一个,只在所属的loop线程中使用,因此不加锁
+//Buffer从这里借用内存块作为存储,连接空闲时把内存块还回来,
+//这样大量空闲的长连接不再各自占着一块缓冲区
+class ChunkPool : noncopyable {
+public:
+    static const size_t kChunkSize = 32 * 1024;//每个内存块的大小
+    static const size_t kDefaultMaxIdleChunks = 256;//默认最多缓存的空闲块数
+
+    explicit ChunkPool(size_t maxIdleChunks = kDefaultMaxIdleChunks)
+        : maxIdleChunks_(maxIdleChunks),
+          chunksInUse_(0),
+          lowWater_(0)
+    {
+    }
+    ~ChunkPool();
+
+    //取一个内存块,空闲链表为空时向系统申请,内容未初始化
+    char* allocate();
+
+    //归还内存块,空闲块超过上限时直接释放给系统
+    void deallocate(char* chunk);
+
+    //释放所有空闲块
+    void shrink();
+
+    //释放自上次trim以来一直没有被用到的空闲块,由定时器周期性调用
+    void trim();
+
+    void setMaxIdleChunks(size_t n) { maxIdleChunks_ = n; }
+
+    size_t chunksInUse() const { return chunksInUse_; }
+    size_t idleChunks() const { return freeList_.size(); }
+
+private:
+    std::vector<char*> freeList_;//空闲内存块
+    size_t maxIdleChunks_;//空闲块上限
+    size_t chunksInUse_;//已借出的内存块数
+    size_t lowWater_;//自上次trim以来空闲链表长度的最小值
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "DelimiterScanner.h"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DELIMITER_SCANNER_X86 1
+#endif
+
+namespace
+{
+
+using ScanFunc = bool (*)(const char *, const char *, DelimiterScanner::LineScan *);
+
+//记录块中第一个':'和' '的位置,base是块首相对行首的偏移
+inline void recordMasks(size_t base, uint32_t colon, uint32_t space,
+                        DelimiterScanner::LineScan *scan)
+{
+    if (scan->colon < 0 && colon)
+    {
+        scan->colon = static_cast<ssize_t>(base + __builtin_ctz(colon));
+    }
+    if (scan->space < 0 && space)
+    {
+        scan->space = static_cast<ssize_t>(base + __builtin_ctz(space));
+    }
+}
+
+//处理一个块的比较结果,块内找到\r\n时返回true
+//cr的每一位表示块内对应字节是否为'\r',还要确认下一个字节是'\n'
+inline bool consumeBlock(const char *begin, size_t len, size_t base,
+                         uint32_t cr, uint32_t colon, uint32_t space,
+                         DelimiterScanner::LineScan *scan)
+{
+    while (cr)
+    {
+        int bit = __builtin_ctz(cr);
+        size_t pos = base + bit;
+        if (pos + 1 < len && begin[pos + 1] == '\n')
+        {
+            uint32_t below = (1u << bit) - 1; //只保留\r之前的位
+            recordMasks(base, colon & below, space & below, scan);
+            scan->crlf = static_cast<ssize_t>(pos);
+            scan->scanned = pos;
+            return true;
+        }
+        cr &= cr - 1;
+    }
+    recordMasks(base, colon, space, scan);
+    return false;
+}
+
+//逐字节扫描[i, len),所有实现都用它处理不足一个块的尾部
+bool scanTail(const char *begin, size_t len, size_t i, DelimiterScanner::LineScan *scan)
+{
+    for (; i < len; ++i)
+    {
+        char c = begin[i];
+        if (c == '\r' && i + 1 < len && begin[i + 1] == '\n')
+        {
+            scan->crlf = static_cast<ssize_t>(i);
+            scan->scanned = i;
+            return true;
+        }
+        if (c == ':' && scan->colon < 0)
+        {
+            scan->colon = static_cast<ssize_t>(i);
+        }
+        else if (c == ' ' && scan->space < 0)
+        {
+            scan->space = static_cast<ssize_t>(i);
+        }
+    }
+    //最后一个字节是'\r'时,'\n'可能还没到,下次从'\r'开始重新检查
+    scan->scanned = (len > 0 && begin[len - 1] == '\r') ? len - 1 : len;
+    return false;
+}
+
+bool scanScalar(const char *begin, const char *end, DelimiterScanner::LineScan *scan)
+{
+    return scanTail(begin, end - begin, scan->scanned, scan);
+}
+
+#ifdef DELIMITER_SCANNER_X86
+
+__attribute__((target("sse2")))
+bool scanSse2(const char *begin, const char *end, DelimiterScanner::LineScan *scan)
+{
+    const size_t len = end - begin;
+    size_t i = scan->scanned;
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i space = _mm_set1_epi8(' ');
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin + i));
+        uint32_t mcr = _mm_movemask_epi8(_mm_cmpeq_epi8(v, cr));
+        uint32_t mcolon = _mm_movemask_epi8(_mm_cmpeq_epi8(v, colon));
+        uint32_t mspace = _mm_movemask_epi8(_mm_cmpeq_epi8(v, space));
+        if (consumeBlock(begin, len, i, mcr, mcolon, mspace, scan))
+        {
+            return true;
+        }
+    }
+    return scanTail(begin, len, i, scan);
+}
+
+__attribute__((target("avx2")))
+bool scanAvx2(const char *begin, const char *end, DelimiterScanner::LineScan *scan)
+{
+    const size_t len = end - begin;
+    size_t i = scan->scanned;
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i space = _mm256_set1_epi8(' ');
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin + i));
+        uint32_t mcr = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, cr));
+        uint32_t mcolon = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, colon));
+        uint32_t mspace = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, space));
+        if (consumeBlock(begin, len, i, mcr, mcolon, mspace, scan))
+        {
+            return true;
+        }
+    }
+    return scanTail(begin, len, i, scan);
+}
+
+#endif
+
+//程序启动时根据CPU特性选择一次实现
+ScanFunc resolveScan(const char **name)
+{
+#ifdef DELIMITER_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        *name = "avx2";
+        return scanAvx2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        *name = "sse2";
+        return scanSse2;
+    }
+#endif
+    *name = "scalar";
+    return scanScalar;
+}
+
+const char *g_scanName = "scalar";
+const ScanFunc g_scan = resolveScan(&g_scanName);
+
+} // namespace
+
+bool DelimiterScanner::scanLine(const char *begin, const char *end, LineScan *scan)
+{
+    return g_scan(begin, end, scan);
+}
+
+const char *DelimiterScanner::findCRLF(const char *begin, const char *end)
+{
+    LineScan scan;
+    return g_scan(begin, end, &scan) ? begin + scan.crlf : nullptr;
+}
+
+const char *DelimiterScanner::implementation()
+{
+    return g_scanName;
+}
@@ -1,6 +1,8 @@
 #include "EventLoop.h"
 #include "Logging.h"
 #include "Poller.h"
+#include "ChunkPool.h"
+#include "TimingWheel.h"
 __thread EventLoop *t_loopInThisThread = nullptr;
 //定义了一个指向 EventLoop 对象的线程本地指针 
 //t_loopInThisThread，并将其初始化为 nullptr。
@@ -41,10 +43,28 @@ EventLoop::EventLoop()
     : looping_(false),
       quit_(false),
       callingPendingFunctors_(false),
+      sleeping_(false),
+      wakeupPending_(false),
+      wakeupCount_(0),
+      busyPollMicros_(0),
+      spinMicros_(0),
+      handleMicros_(0),
+      spinPolls_(0),
+      blockingPolls_(0),
+      maxEventsPerPoll_(0),
+      maxFunctors_(0),
+      maxReadBytes_(0),
+      eventBudgetHits_(0),
+      functorBudgetHits_(0),
+      readBudgetHits_(0),
+      connectionCount_(0),
+      pendingBytes_(0),
       threadId_(CurrentThread::tid()),
       poller_(Poller::newDefaultPoller(this)),
       //这里的poller_充当主要的IO复用类，它是一个多路事件分发器的核心IO复用类
       timerQueue_(new TimerQueue(this)),
+      chunkPool_(new ChunkPool),
+      timingWheel_(new TimingWheel(this)),
       wakeupFd_(createEventfd()),
       wakeupChannel_(new Channel(this, wakeupFd_)),
       currentActiveChannel_(nullptr)
@@ -85,18 +105,86 @@ void EventLoop::loop()
     LOG_INFO << "EventLoop " << this << " start looping";
     while(!quit_){
         activeChannels_.clear();//清空activeChannels_,防止上次的数据影响本次的数据
-        pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        int maxEvents = maxEventsPerPoll_.load(std::memory_order_relaxed);
+        poller_->setMaxEvents(maxEvents);
+        poller_->flushUpdates();//上一轮对关注事件的修改合并后一起提交
+        int64_t busyPoll = busyPollMicros_.load(std::memory_order_relaxed);
+        TimeStamp pollStart;
+        bool spinning = false;
+        if (busyPoll > 0)
+        {
+            //忙轮询模式:最近一次有活之后的busyPoll微秒内不阻塞
+            pollStart = TimeStamp::now();
+            spinning = pollStart.microSecondsSinceEpoch() - lastActive_.microSecondsSinceEpoch() < busyPoll;
+        }
+        if (spinning)
+        {
+            //空转时sleeping_保持false,投递任务的线程不用写eventfd,下一轮就会执行到
+            pollReturnTime_ = poller_->poll(0, &activeChannels_);
+        }
+        else
+        {
+            //先声明要睡眠再检查队列,queueInLoop先入队再检查sleeping_,两边都是seq_cst,
+            //要么这里看到新任务不阻塞,要么投递方看到sleeping_写eventfd,不会漏掉唤醒
+            sleeping_.store(true);
+            int timeoutMs = pendingFunctors_.empty() ? kPollTimeMs : 0;
+            pollReturnTime_ = poller_->poll(timeoutMs, &activeChannels_);
+            sleeping_.store(false);
+            wakeupPending_.store(false);
+        }
         //这里会阻塞kPollTimeMs时间,直到有活跃的channel或者超时
         //传入pooler_的参数为kPollTimeMs和activeChannels_
         //kPollTimeMs为poll的超时时间，activeChannels_为活跃的channel
         //poller_->poll()返回的是活跃的channel的数量
-        for (Channel *channel : activeChannels_)//遍历活跃的channel
+        // 同一批事件中,前面的回调可能已经移除甚至析构了后面的Channel,fd也可能被关闭后复用,
+        // 先记下每个Channel的fd和注册代数,分发前确认它仍是当时注册的那一个
+        activeKeys_.clear();
+        for (Channel *channel : activeChannels_)
+        {
+            activeKeys_.push_back(std::make_pair(channel->fd(), poller_->generation(channel->fd())));
+        }
+        for (size_t i = 0; i < activeChannels_.size(); ++i)//遍历活跃的channel
         {
+            Channel *channel = activeChannels_[i];
+            if (!poller_->isRegistered(activeKeys_[i].first, activeKeys_[i].second, channel))
+            {
+                continue;
+            }
             channel->handleEvent(pollReturnTime_);
         }
+        if (maxEvents > 0 && activeChannels_.size() >= static_cast<size_t>(maxEvents))
+        {
+            eventBudgetHits_.fetch_add(1, std::memory_order_relaxed);
+        }
         
-        doPendingFunctors();
+        size_t numFunctors = doPendingFunctors();
         //执行pendingFunctors_中的函数,这里的函数是在其他线程中添加的
+
+        if (busyPoll > 0)
+        {
+            bool idle = activeChannels_.empty() && numFunctors == 0;
+            if (spinning)
+            {
+                spinPolls_.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                blockingPolls_.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (spinning && idle)
+            {
+                spinMicros_.fetch_add(pollReturnTime_.microSecondsSinceEpoch() - pollStart.microSecondsSinceEpoch(),
+                                      std::memory_order_relaxed);
+            }
+            else
+            {
+                //阻塞返回或者拿到了事件,重新开始计算空转时间
+                TimeStamp handled = TimeStamp::now();
+                handleMicros_.fetch_add(handled.microSecondsSinceEpoch() - pollReturnTime_.microSecondsSinceEpoch(),
+                                        std::memory_order_relaxed);
+                lastActive_ = handled;
+            }
+        }
     }
     looping_ = false;
 }
@@ -125,12 +213,11 @@ void EventLoop::runInLoop(Functor cb)
 //添加回调函数到pendingFunctors_中
 void EventLoop::queueInLoop(Functor cb)
 {
+    pendingFunctors_.push(std::move(cb));
+    //loop没有睡眠时(包括在loop线程中调用),它在下次poll之前会检查队列,不用唤醒
+    //多个线程同时投递时只有第一个写eventfd
+    if (sleeping_.load() && !wakeupPending_.exchange(true))
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.push_back(std::move(cb));
-    }
-    if(!isInLoopThread() || callingPendingFunctors_)
-    {//如果当前线程不是loop线程,或者正在执行pendingFunctors_中的函数,则唤醒loop()
         wakeup();
     }
 }
@@ -139,6 +226,7 @@ void EventLoop::queueInLoop(Functor cb)
 void EventLoop::wakeup()
 {
     uint64_t one = 1;
+    wakeupCount_.fetch_add(1, std::memory_order_relaxed);
     ssize_t n = ::write(wakeupFd_, &one, sizeof one);
     //向wakeupFd_写入数据,这样wakeupChannel_就会被添加到poller_中,从而唤醒loop()
     //这里唤醒的是创建EventLoop对象的线程
@@ -173,23 +261,49 @@ bool EventLoop::hasChannel(Channel *channel)
     return poller_->hasChannel(channel);
 }
 
-void EventLoop::doPendingFunctors()
+size_t EventLoop::doPendingFunctors()
 {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
-
+    //只执行开始时已经在队列中的函数,执行过程中新加入的留到下一轮
+    //设置了上限时多出来的也留到下一轮,队列不空下一轮poll就不会阻塞
+    size_t maxFunctors = maxFunctors_.load(std::memory_order_relaxed);
+    size_t n = pendingFunctors_.consume([](Functor &functor) { functor(); }, maxFunctors);
+    callingPendingFunctors_ = false;
+    if (maxFunctors > 0 && n == maxFunctors && !pendingFunctors_.empty())
     {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_);//将pendingFunctors_中的函数赋值给functors
+        functorBudgetHits_.fetch_add(1, std::memory_order_relaxed);
     }
+    return n;
+}
 
-    for (const Functor &functor : functors)//遍历functors,执行其中的函数
-    {
-        functor();
-    }
-    callingPendingFunctors_ = false;
+EventLoop::BusyPollStats EventLoop::busyPollStats() const
+{
+    BusyPollStats stats;
+    stats.spinMicros = spinMicros_.load(std::memory_order_relaxed);
+    stats.handleMicros = handleMicros_.load(std::memory_order_relaxed);
+    stats.spinPolls = spinPolls_.load(std::memory_order_relaxed);
+    stats.blockingPolls = blockingPolls_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+EventLoop::BudgetStats EventLoop::budgetStats() const
+{
+    BudgetStats stats;
+    stats.eventBudgetHits = eventBudgetHits_.load(std::memory_order_relaxed);
+    stats.functorBudgetHits = functorBudgetHits_.load(std::memory_order_relaxed);
+    stats.readBudgetHits = readBudgetHits_.load(std::memory_order_relaxed);
+    return stats;
 }
 
+uint64_t EventLoop::epollCtlCalls() const
+{
+    return poller_->ctlCalls();
+}
+
+const char *EventLoop::pollerName() const
+{
+    return poller_->name();
+}
 
 // int main()
 // {
@@ -5,14 +5,17 @@
 #include "CurrentThread.h"
 #include "TimeStamp.h"
 #include "TimerQueue.h"
+#include "MpscQueue.h"
+#include "InlineFunction.h"
 
 
 
 #include <functional>
 #include <memory>
 #include <vector>
+#include <utility>
 #include <atomic>
-#include <mutex>
+#include <stdint.h>
 #include <unistd.h>
 #include <sys/eventfd.h>
 #include <fcntl.h>
@@ -20,11 +23,13 @@
 
 class Channel;
 class Poller;
+class ChunkPool;
+class TimingWheel;
 
 class EventLoop : noncopyable
 {
 public:
-    using Functor = std::function<void()>;//回调函数
+    using Functor = InlineFunction;//回调函数,只能移动,常见的闭包不分配内存
     EventLoop();
     ~EventLoop();
 
@@ -36,7 +41,10 @@ public:
     void runInLoop(Functor cb);//在当前线程中执行回调函数
 
     void queueInLoop(Functor cb);//在当前线程中执行回调函数
+    //任意线程都可以调用,不加锁;只有loop阻塞在poll中时才写eventfd唤醒,同时投递的多个线程只唤醒一次
 
+    size_t wakeupCount() const { return wakeupCount_.load(std::memory_order_relaxed); }
+    //实际写eventfd的次数
 
     void wakeup();//唤醒
 
@@ -47,6 +55,60 @@ public:
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); }
     //是否在当前线程中
 
+    ChunkPool* chunkPool() const { return chunkPool_.get(); }
+    //本loop的内存块池,只能在loop线程中使用
+
+    TimingWheel* timingWheel() const { return timingWheel_.get(); }
+    //本loop的时间轮,用于连接空闲超时等大量、频繁刷新的定时,只能在loop线程中使用
+
+    //忙轮询:有事件或任务之后的micros微秒内用epoll_wait(0)空转,超过后才阻塞,0表示关闭
+    //用一个核换取更低的延迟,空转期间其他线程投递任务不需要写eventfd,可以在任意线程设置
+    void setBusyPoll(int64_t micros) { busyPollMicros_.store(micros, std::memory_order_relaxed); }
+    int64_t busyPoll() const { return busyPollMicros_.load(std::memory_order_relaxed); }
+
+    //开启忙轮询后的统计,时间单位为微秒
+    struct BusyPollStats
+    {
+        int64_t spinMicros;   //空转(epoll_wait(0)没有拿到事件)的时间
+        int64_t handleMicros; //处理事件和任务的时间
+        uint64_t spinPolls;   //空转的次数
+        uint64_t blockingPolls; //阻塞等待的次数
+    };
+    BusyPollStats busyPollStats() const;
+
+    //每轮循环的工作量上限,0表示不限制,超出的部分留到下一轮,避免一轮循环拖得太久拉高尾延迟
+    //都可以在任意线程设置
+    void setMaxEventsPerPoll(int n) { maxEventsPerPoll_.store(n, std::memory_order_relaxed); }
+    //一次epoll_wait最多处理的就绪事件数,其余的事件(水平触发)下一轮还会返回
+    void setMaxFunctorsPerIteration(size_t n) { maxFunctors_.store(n, std::memory_order_relaxed); }
+    //一轮最多执行的任务数,剩下的留在队列中,下一轮poll不阻塞
+    void setMaxReadBytesPerConnection(size_t n) { maxReadBytes_.store(n, std::memory_order_relaxed); }
+    //一个连接每次可读事件最多读取的字节数,剩下的数据留在socket中下一轮再读
+    size_t maxReadBytesPerConnection() const { return maxReadBytes_.load(std::memory_order_relaxed); }
+
+    //各项上限被触发的次数
+    struct BudgetStats
+    {
+        uint64_t eventBudgetHits;
+        uint64_t functorBudgetHits;
+        uint64_t readBudgetHits;
+    };
+    BudgetStats budgetStats() const;
+
+    //本loop上的连接数和输出队列中待发送的字节数,由TcpConnection维护,
+    //EventLoopThreadPool按负载分配连接时使用,可以在任意线程读取
+    void addConnections(int64_t n) { connectionCount_.fetch_add(n, std::memory_order_relaxed); }
+    void addPendingBytes(int64_t n) { pendingBytes_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t connectionCount() const { return connectionCount_.load(std::memory_order_relaxed); }
+    int64_t pendingBytes() const { return pendingBytes_.load(std::memory_order_relaxed); }
+
+    uint64_t epollCtlCalls() const;
+    //累计的epoll_ctl调用次数
+
+    const char* pollerName() const;
+    //使用的IO复用后端,设置环境变量TINY_NETWORK_USE_URING时优先使用io_uring
+    void countReadBudgetHit() { readBudgetHits_.fetch_add(1, std::memory_order_relaxed); }
+
     void runAt(const TimeStamp& time, Functor&& cb)//在指定时间执行回调函数
     {
         timerQueue_->addTimer(std::move(cb), time, 0.0);
@@ -66,26 +128,47 @@ public:
 
 private:
     void handleRead();//处理读事件
-    void doPendingFunctors();//执行回调函数
+    size_t doPendingFunctors();//执行回调函数,返回执行的个数
 
     using ChannelList = std::vector<Channel*>;
     std::atomic_bool looping_;//是否在循环
     std::atomic_bool quit_;//是否退出
     std::atomic_bool callingPendingFunctors_;//是否在执行回调函数
+    std::atomic_bool sleeping_;//即将或正在阻塞在poll中
+    std::atomic_bool wakeupPending_;//已经有线程写了eventfd,loop醒来之前不用再写
+    std::atomic<size_t> wakeupCount_;
+
+    std::atomic<int64_t> busyPollMicros_;
+    TimeStamp lastActive_;//最近一次拿到事件或执行任务的时间,忙轮询从这里开始计时
+    std::atomic<int64_t> spinMicros_;
+    std::atomic<int64_t> handleMicros_;
+    std::atomic<uint64_t> spinPolls_;
+    std::atomic<uint64_t> blockingPolls_;
+
+    std::atomic<int> maxEventsPerPoll_;
+    std::atomic<size_t> maxFunctors_;
+    std::atomic<size_t> maxReadBytes_;
+    std::atomic<uint64_t> eventBudgetHits_;
+    std::atomic<uint64_t> functorBudgetHits_;
+    std::atomic<uint64_t> readBudgetHits_;
+    std::atomic<int64_t> connectionCount_;
+    std::atomic<int64_t> pendingBytes_;
     const pid_t threadId_;//线程id
     TimeStamp pollReturnTime_;//poll返回的时间
     std::unique_ptr<Poller> poller_;//poller对象
     
     
     std::unique_ptr<TimerQueue> timerQueue_;//定时器队列
+    std::unique_ptr<ChunkPool> chunkPool_;//连接缓冲区使用的内存块池
+    std::unique_ptr<TimingWheel> timingWheel_;//比timerQueue_先析构
                     
     int wakeupFd_;//唤醒描述符
     std::unique_ptr<Channel> wakeupChannel_;//唤醒通道
 
     ChannelList activeChannels_;//活跃通道
+    std::vector<std::pair<int, uint32_t>> activeKeys_;//活跃通道的fd和poll返回时的注册代数
     Channel* currentActiveChannel_;//当前活跃通道
-    std::mutex mutex_;//互斥锁
-    std::vector<Functor> pendingFunctors_;//回调函数队列
+    MpscQueue<Functor> pendingFunctors_;//回调函数队列,无锁,任意线程push,只有loop线程取出
     
 };
 
@@ -1,5 +1,6 @@
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "CpuAffinity.h"
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback& cb, const std::string& name)
     : loop_(nullptr),
@@ -7,7 +8,8 @@ EventLoopThread::EventLoopThread(const ThreadInitCallback& cb, const std::string
       thread_(std::bind(&EventLoopThread::threadFunc, this), name),
       mutex_(),
       cond_(),
-      callback_(cb)
+      callback_(cb),
+      cpu_(-1)
 {
 }
 
@@ -43,6 +45,10 @@ EventLoop* EventLoopThread::startLoop()
 //最后调用EventLoop的loop函数
 void EventLoopThread::threadFunc()
 {
+    if (cpu_ >= 0)
+    {
+        CpuAffinity::bindCurrentThread(cpu_);
+    }
     EventLoop loop;
     /* 对EventLoop 对象进行自定义的初始化操作，比如添加定时器、监听文件描述符等。*/
     if (callback_)
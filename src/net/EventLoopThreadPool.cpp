@@ -2,13 +2,36 @@
 
 #include"EventLoopThread.h"
 #include "EventLoopThreadPool.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "CpuAffinity.h"
+
+#include <algorithm>
+
+//每个loop在哈希环上的虚拟节点数,越多分布越均匀
+static const int kVirtualNodes = 100;
+
+//把32位整数打散,用于哈希环
+static uint32_t mixHash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
 
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
     : baseLoop_(baseLoop),
       name_(nameArg),
       started_(false),
       numThreads_(0),
-      next_(0)
+      next_(0),
+      policy_(kRoundRobin),
+      randomState_(0x9e3779b97f4a7c15ULL),
+      preferLocalNode_(false),
+      localNext_(0)
 {
 }
 
@@ -25,10 +48,47 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
         char buf[name_.size() + 32];
         snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
         EventLoopThread *t = new EventLoopThread(cb, buf);
+        if (!cpus_.empty())
+        {
+            t->setCpu(cpus_[i % cpus_.size()]);
+        }
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(t->startLoop());
         
     }
+    //提前查好每个CPU所在的节点,分配连接时不再读/sys
+    if (!cpus_.empty())
+    {
+        for (int cpu : CpuAffinity::allowedCpus())
+        {
+            if (cpu >= static_cast<int>(cpuNodes_.size()))
+            {
+                cpuNodes_.resize(cpu + 1, -1);
+            }
+            cpuNodes_[cpu] = CpuAffinity::numaNodeOfCpu(cpu);
+        }
+        for (size_t i = 0; i < threads_.size(); ++i)
+        {
+            int cpu = threads_[i]->cpu();
+            int node = cpu < static_cast<int>(cpuNodes_.size()) && cpuNodes_[cpu] >= 0
+                           ? cpuNodes_[cpu]
+                           : CpuAffinity::numaNodeOfCpu(cpu);
+            if (node >= static_cast<int>(nodeLoops_.size()))
+            {
+                nodeLoops_.resize(node + 1);
+            }
+            nodeLoops_[node].push_back(loops_[i]);
+        }
+    }
+    //一致性哈希环,loop编号和虚拟节点编号一起哈希
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+        for (int v = 0; v < kVirtualNodes; ++v)
+        {
+            hashRing_.push_back(std::make_pair(mixHash(static_cast<uint32_t>(i * kVirtualNodes + v) + 1), loops_[i]));
+        }
+    }
+    std::sort(hashRing_.begin(), hashRing_.end());
     //如果只有一个loop，那么就是baseLoop。
     if (numThreads_ == 0 && cb)
     {
@@ -37,6 +97,11 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     }
 }
 
+void EventLoopThreadPool::setAutoCpuAffinity()
+{
+    cpus_ = CpuAffinity::onePerCore();
+}
+
 //以轮询的方式分配一个loop
 EventLoop *EventLoopThreadPool::getNextLoop()
 {
@@ -55,6 +120,99 @@ EventLoop *EventLoopThreadPool::getNextLoop()
     return loop;
 }
 
+EventLoop *EventLoopThreadPool::getLoopForConnection(const InetAddress &peerAddr, int incomingCpu)
+{
+    if (loops_.empty())
+    {
+        return baseLoop_;
+    }
+    const std::vector<EventLoop *> &loops = localLoops(incomingCpu);
+    if (dispatchCallback_)
+    {
+        return dispatchCallback_(loops, peerAddr);
+    }
+    switch (policy_)
+    {
+    case kLeastConnections:
+        return leastLoaded(loops, false);
+    case kLeastPendingBytes:
+        return leastLoaded(loops, true);
+    case kPowerOfTwoChoices:
+        return powerOfTwoChoices(loops);
+    case kConsistentHash:
+        return consistentHash(peerAddr);
+    default:
+        return roundRobin(loops);
+    }
+}
+
+//和incomingCpu在同一NUMA节点上的loop,没有开启、不知道节点或者该节点上没有loop时返回所有loop
+const std::vector<EventLoop *> &EventLoopThreadPool::localLoops(int incomingCpu) const
+{
+    if (!preferLocalNode_ || nodeLoops_.size() < 2 ||
+        incomingCpu < 0 || incomingCpu >= static_cast<int>(cpuNodes_.size()))
+    {
+        return loops_;
+    }
+    int node = cpuNodes_[incomingCpu];
+    if (node < 0 || node >= static_cast<int>(nodeLoops_.size()) || nodeLoops_[node].empty())
+    {
+        return loops_;
+    }
+    return nodeLoops_[node];
+}
+
+EventLoop *EventLoopThreadPool::roundRobin(const std::vector<EventLoop *> &loops)
+{
+    if (&loops == &loops_)
+    {
+        return getNextLoop();
+    }
+    //只在一个节点内轮询,连接总是落在本节点,单独计数
+    return loops[localNext_++ % loops.size()];
+}
+
+//负载相同时取靠前的loop
+EventLoop *EventLoopThreadPool::leastLoaded(const std::vector<EventLoop *> &loops, bool byBytes) const
+{
+    EventLoop *best = loops[0];
+    int64_t bestLoad = byBytes ? best->pendingBytes() : best->connectionCount();
+    for (size_t i = 1; i < loops.size(); ++i)
+    {
+        int64_t load = byBytes ? loops[i]->pendingBytes() : loops[i]->connectionCount();
+        if (load < bestLoad)
+        {
+            best = loops[i];
+            bestLoad = load;
+        }
+    }
+    return best;
+}
+
+EventLoop *EventLoopThreadPool::powerOfTwoChoices(const std::vector<EventLoop *> &loops)
+{
+    //xorshift64,不需要很好的随机性
+    randomState_ ^= randomState_ << 13;
+    randomState_ ^= randomState_ >> 7;
+    randomState_ ^= randomState_ << 17;
+    size_t n = loops.size();
+    EventLoop *a = loops[randomState_ % n];
+    EventLoop *b = loops[(randomState_ >> 32) % n];
+    return b->connectionCount() < a->connectionCount() ? b : a;
+}
+
+EventLoop *EventLoopThreadPool::consistentHash(const InetAddress &peerAddr) const
+{
+    uint32_t h = mixHash(peerAddr.getSockAddr()->sin_addr.s_addr);
+    auto it = std::lower_bound(hashRing_.begin(), hashRing_.end(),
+                               std::make_pair(h, static_cast<EventLoop *>(nullptr)));
+    if (it == hashRing_.end())
+    {
+        it = hashRing_.begin();
+    }
+    return it->second;
+}
+
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
 {
     if (loops_.empty())
@@ -0,0 +1,189 @@
+#include "OutputQueue.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+namespace
+{
+//持有文件描述符,最后一个引用释放时close
+struct FileCloser {
+    explicit FileCloser(int fd) : fd(fd) {}
+    ~FileCloser() { ::close(fd); }
+    int fd;
+};
+}
+
+const size_t OutputQueue::kMaxCoalesce;
+
+void OutputQueue::append(const char* data, size_t len){
+    if(len == 0){
+        return;
+    }
+    //小块数据直接拼到末尾的自有段中
+    if(!segments_.empty() && segments_.back().type == Segment::kOwned && len <= kMaxCoalesce){
+        Segment& tail = segments_.back();
+        tail.owned.append(data, len);
+        tail.len += len;
+    }else{
+        segments_.emplace_back(Segment::kOwned, nullptr, len);
+        segments_.back().owned.assign(data, len);
+    }
+    bytes_ += len;
+}
+
+void OutputQueue::append(std::string&& str){
+    if(str.empty()){
+        return;
+    }
+    size_t len = str.size();
+    segments_.emplace_back(Segment::kOwned, nullptr, len);
+    segments_.back().owned.swap(str);
+    bytes_ += len;
+}
+
+void OutputQueue::append(const Block& block){
+    if(!block || block->empty()){
+        return;
+    }
+    segments_.emplace_back(Segment::kShared, block->data(), block->size());
+    segments_.back().block = block;
+    bytes_ += block->size();
+}
+
+void OutputQueue::appendBorrowed(const char* data, size_t len){
+    if(len == 0){
+        return;
+    }
+    segments_.emplace_back(Segment::kBorrowed, data, len);
+    bytes_ += len;
+}
+
+void OutputQueue::appendFile(int fd, off_t offset, size_t len){
+    std::shared_ptr<const void> holder(std::make_shared<FileCloser>(fd));
+    if(len == 0){
+        return;
+    }
+    struct stat st;
+    segments_.emplace_back(Segment::kFile, nullptr, len);
+    Segment& seg = segments_.back();
+    seg.fileFd = fd;
+    seg.fileOffset = offset;
+    seg.isPipe = ::fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+    seg.holder = holder;
+    bytes_ += len;
+}
+
+void OutputQueue::append(OutputQueue&& other){
+    for(Segment& seg : other.segments_){
+        segments_.push_back(std::move(seg));
+    }
+    bytes_ += other.bytes_;
+    other.segments_.clear();
+    other.bytes_ = 0;
+}
+
+void OutputQueue::retrieve(size_t len){
+    assert(len <= bytes_);
+    bytes_ -= len;
+    while(len > 0){
+        Segment& front = segments_.front();
+        size_t n = std::min(len, front.remaining());
+        front.offset += n;
+        len -= n;
+        if(front.remaining() == 0){
+            segments_.pop_front();
+        }
+    }
+}
+
+int OutputQueue::blockedPipeFd() const{
+    if(segments_.empty() || segments_.front().type != Segment::kFile || !segments_.front().isPipe){
+        return -1;
+    }
+    int available = 0;
+    if(::ioctl(segments_.front().fileFd, FIONREAD, &available) < 0 || available > 0){
+        return -1;
+    }
+    return segments_.front().fileFd;
+}
+
+void OutputQueue::retrieveAll(){
+    segments_.clear();
+    bytes_ = 0;
+}
+
+ssize_t OutputQueue::writeFd(int fd, int* savedErrno){
+    ssize_t total = 0;
+    while(!segments_.empty()){
+        size_t expect = 0;
+        ssize_t n = segments_.front().type == Segment::kFile
+                    ? writeFile(fd, &expect, savedErrno)
+                    : writeMemory(fd, &expect, savedErrno);
+        if(n < 0){
+            //已经写出部分数据时,把本次的错误留给下一次调用处理
+            return total > 0 ? total : n;
+        }
+        total += n;
+        if(static_cast<size_t>(n) < expect){
+            break;//内核发送缓冲区已满
+        }
+    }
+    return total;
+}
+
+ssize_t OutputQueue::writeMemory(int fd, size_t* expect, int* savedErrno){
+    struct iovec vec[IOV_MAX];
+    int iovcnt = 0;
+    *expect = 0;
+    for(const Segment& seg : segments_){
+        if(iovcnt == IOV_MAX || seg.type == Segment::kFile){
+            break;
+        }
+        vec[iovcnt].iov_base = const_cast<char*>(seg.peek());
+        vec[iovcnt].iov_len = seg.remaining();
+        *expect += seg.remaining();
+        ++iovcnt;
+    }
+    const ssize_t n = ::writev(fd, vec, iovcnt);
+    //writev按顺序写出各个数据段,写了多少就从队列头部丢弃多少
+    if(n < 0){
+        *savedErrno = errno;
+    }else{
+        retrieve(n);
+    }
+    return n;
+}
+
+ssize_t OutputQueue::writeFile(int fd, size_t* expect, int* savedErrno){
+    Segment& seg = segments_.front();
+    ssize_t n = 0;
+    *expect = seg.remaining();
+    if(seg.isPipe){
+        //管道不支持sendfile,用splice把管道中的数据直接搬到socket
+        n = ::splice(seg.fileFd, NULL, fd, NULL, seg.remaining(),
+                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }else{
+        off_t off = seg.fileOffset + static_cast<off_t>(seg.offset);
+        n = ::sendfile(fd, seg.fileFd, &off, seg.remaining());
+        //sendfile在内核中把文件页直接拷贝到socket,不经过用户态
+    }
+    if(n < 0){
+        *savedErrno = errno;
+    }else if(n == 0){
+        //文件或管道比声明的长度短,长度已经告诉了对端(如Content-Length),后面的数据无法再正确分帧
+        //按错误处理,由连接关闭
+        *savedErrno = EIO;
+        n = -1;
+    }else{
+        retrieve(n);
+    }
+    return n;
+}
@@ -0,0 +1,98 @@
+#ifndef OUTPUT_QUEUE_H
+#define OUTPUT_QUEUE_H
+
+#include "noncopyable.h"
+
+#include <deque>
+#include <string>
+#include <memory>
+#include <sys/types.h>
+
+//输出队列:由若干数据段组成的链表,用writev一次性把多个数据段写入socket,
+//避免把响应头、响应体、缓存数据先拷贝到一块连续的内存中
+//数据段有四种:
+//  自有字符串(kOwned):队列持有的std::string,小块数据追加时会合并到末尾的自有段
+//  共享块(kShared):不可变的std::shared_ptr<const std::string>,多个连接可以共用一份数据
+//  借用片段(kBorrowed):只保存指针和长度,调用方需保证数据在发送完成前有效
+//  文件区间(kFile):文件描述符上的一段数据,用sendfile/splice直接在内核中发送
+class OutputQueue : noncopyable {
+public:
+    using Block = std::shared_ptr<const std::string>;//不可变的共享数据块
+
+    static const size_t kMaxCoalesce = 4096;
+    //小于该长度的拷贝追加合并到末尾的自有段中,避免产生大量细碎的数据段
+
+    OutputQueue() : bytes_(0) {}
+
+    size_t readableBytes() const { return bytes_; }
+    bool empty() const { return bytes_ == 0; }
+    size_t segmentCount() const { return segments_.size(); }
+
+    //拷贝data追加到队列末尾
+    void append(const char* data, size_t len);
+    void append(const std::string& str) { append(str.data(), str.size()); }
+
+    //转移str的所有权,不拷贝
+    void append(std::string&& str);
+
+    //追加共享块,只增加引用计数
+    void append(const Block& block);
+
+    //追加借用片段,不拷贝也不持有数据
+    void appendBorrowed(const char* data, size_t len);
+
+    //追加文件fd中[offset, offset+len)的区间,fd的所有权转移给队列,发送完毕或丢弃时close
+    //fd是管道时offset被忽略,改用splice发送
+    void appendFile(int fd, off_t offset, size_t len);
+
+    //把other中的数据段全部转移到队列末尾,other被清空
+    void append(OutputQueue&& other);
+
+    //丢弃队列前面len个字节
+    void retrieve(size_t len);
+    void retrieveAll();
+
+    //把队列中的数据写入fd,直到写完或者内核发送缓冲区已满,返回写入的字节数
+    //内存中的数据段以writev发出,一次最多IOV_MAX个;文件区间以sendfile/splice发出
+    //文件区间的数据不足声明的长度时返回-1,*savedErrno为EIO
+    ssize_t writeFd(int fd, int* savedErrno);
+
+    //队首是管道且管道中暂时没有数据时返回管道的fd,否则返回-1
+    //writeFd返回EAGAIN时用它区分是管道空了还是socket写满了,管道空时应等管道可读,而不是等socket可写
+    int blockedPipeFd() const;
+
+private:
+    struct Segment {
+        enum Type { kOwned, kShared, kBorrowed, kFile };
+
+        Segment(Type t, const char* d, size_t n)
+            : type(t), data(d), len(n), offset(0), fileFd(-1), fileOffset(0), isPipe(false) {}
+
+        //自有段的std::string在移动后地址可能改变,所以每次现取首地址
+        const char* peek() const {
+            return (type == kOwned ? owned.data() : data) + offset;
+        }
+        size_t remaining() const { return len - offset; }
+
+        Type type;
+        const char* data;//kShared和kBorrowed的数据首地址
+        size_t len;//数据段总长度
+        size_t offset;//已经写出的字节数
+        std::string owned;//kOwned的数据
+        Block block;//kShared持有的引用
+        int fileFd;//kFile的文件描述符
+        off_t fileOffset;//kFile区间在文件中的起始偏移
+        bool isPipe;//kFile是否为管道,管道只能用splice
+        std::shared_ptr<const void> holder;//kFile负责在最后close文件描述符
+    };
+
+    //writev发送队首连续的内存数据段,expect返回本次期望写出的字节数
+    ssize_t writeMemory(int fd, size_t* expect, int* savedErrno);
+    //sendfile/splice发送队首的文件区间
+    ssize_t writeFile(int fd, size_t* expect, int* savedErrno);
+
+    std::deque<Segment> segments_;
+    size_t bytes_;//队列中尚未写出的字节数
+};
+
+#endif
@@ -60,8 +60,8 @@ int Socket::accept(InetAddress *peeraddr)
     
     if(connfd>=0){
         peeraddr->setSockAddr(addr);
-    }else{
-        LOG_ERROR<<"accept error";
+    }else if(errno != EAGAIN && errno != EWOULDBLOCK){
+        LOG_ERROR<<"accept error";//没有新连接时返回EAGAIN,不是错误
     }
     return connfd;
 }
@@ -122,3 +122,18 @@ void Socket::setKeepAlive(bool on)
         &optval, static_cast<socklen_t>(sizeof optval));
 }
 
+//SO_BUSY_POLL,需要网卡驱动支持,超过net.core.busy_read时需要CAP_NET_ADMIN
+bool Socket::setBusyPoll(int usec)
+{
+#ifdef SO_BUSY_POLL
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL,
+                     &usec, static_cast<socklen_t>(sizeof usec)) < 0)
+    {
+        LOG_ERROR << "setsockopt SO_BUSY_POLL " << usec << " failed, errno " << errno;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
@@ -12,6 +12,9 @@
 #include "Socket.h"
 #include "Logging.h"
 
+// 边沿触发且loop没有设置每连接读取上限时,一次可读事件最多读这么多,剩下的下一轮继续读
+static const size_t kEdgeTriggeredReadBudget = 1024 * 1024;
+
 static EventLoop *checkLoopNotNull(EventLoop *loop)
 {
     if (loop == nullptr)
@@ -25,45 +28,117 @@ TcpConnection::TcpConnection(EventLoop *loop,
                              const std::string &name,
                              int sockfd,
                              const InetAddress &localAddr,
-                             const InetAddress &peerAddr)
+                             const InetAddress &peerAddr,
+                             uint64_t id)
     : loop_(checkLoopNotNull(loop)),
+      ownerLoop_(loop),
+      migrating_(false),
+      migratable_(true),
       name_(name),
+      id_(id),
       state_(kConnecting),
       reading_(true),
+      readResumeQueued_(false),
+      loadCounted_(true),
+      reportedPendingBytes_(0),
+      idleTimeout_(0.0),
+      idleEntry_(std::bind(&TcpConnection::onIdleTimeout, this)),
       socket_(new Socket(sockfd)),
       channel_(new Channel(loop, sockfd)),
+      waitingSource_(false),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64 * 1024 * 1024) // 64MB
+      highWaterMark_(64 * 1024 * 1024), // 64MB
+      inputBuffer_(loop->chunkPool())
 {
-    channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+    setupChannel();
     LOG_DEBUG << "TcpConnection::ctor[" << name_ << "] at " << this
               << " fd=" << sockfd;
     socket_->setKeepAlive(true);
+    // 创建时就计入连接数,同一批新连接分配时能看到前面的连接
+    loop->addConnections(1);
 }
 
 TcpConnection::~TcpConnection()
 {
+    releaseLoad();
     LOG_DEBUG << "TcpConnection::dtor[" << name_ << "] at " << this
               << " fd=" << channel_->fd()
               << " state=" << state_;
 }
 
+void TcpConnection::setupChannel()
+{
+    channel_->setReadCallback(std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
+    channel_->setWriteCallback(std::bind(&TcpConnection::handleWrite, this));
+    channel_->setCloseCallback(std::bind(&TcpConnection::handleClose, this));
+    channel_->setErrorCallback(std::bind(&TcpConnection::handleError, this));
+}
+
+bool TcpConnection::isInLoopThread() const
+{
+    return taskPlace() == kRunHere;
+}
+
+TcpConnection::TaskPlace TcpConnection::taskPlace() const
+{
+    if (getLoop()->isInLoopThread())
+    {
+        return migrating_ ? kDeferred : kRunHere;
+    }
+    if (ownerLoop()->isInLoopThread())
+    {
+        return kOldLoop;
+    }
+    return kElsewhere;
+}
+
+void TcpConnection::retryTask(InlineFunction task, TaskPlace place)
+{
+    if (place == kDeferred)
+    {
+        deferredTasks_.push_back(std::move(task));
+    }
+    else
+    {
+        queueToLoop(std::move(task));
+    }
+}
+
+void TcpConnection::queueToLoop(InlineFunction task)
+{
+    std::lock_guard<std::mutex> lock(loopMutex_);
+    getLoop()->queueInLoop(std::move(task));
+}
+
 void TcpConnection::send(const std::string &message)
 {
     if (state_ == kConnected)
     { // 如果连接处于已连接状态，就调用sendInLoop()函数发送数据
-        if (loop_->isInLoopThread())
+        if (isInLoopThread())
         {
             sendInLoop(message);
         }
         else // 如果不是在IO线程中，就将数据发送任务添加到IO线程的任务队列中
         {
             void (TcpConnection::*fp)(const std::string &message) = &TcpConnection::sendInLoop;
-            loop_->runInLoop(std::bind(fp, this, message));
+            queueToLoop(std::bind(fp, this, message));
+        }
+    }
+}
+
+void TcpConnection::send(std::string &&message)
+{
+    if (state_ == kConnected)
+    {
+        if (isInLoopThread())
+        {
+            sendInLoop(message.data(), message.size());
+        }
+        else // 跨线程发送时把message移动进任务中,省去一次拷贝
+        {
+            void (TcpConnection::*fp)(const std::string &message) = &TcpConnection::sendInLoop;
+            queueToLoop(std::bind(fp, this, std::move(message)));
         }
     }
 }
@@ -72,21 +147,78 @@ void TcpConnection::send(Buffer *message)
 {
     if (state_ == kConnected)
     {
-        if (loop_->isInLoopThread())
+        if (isInLoopThread())
         {
-            sendInLoop(message->beginWrite(), message->readableBytes());
+            sendInLoop(message->beginRead(), message->readableBytes());
             message->retrieveAll();
         }
         else
         {
             void (TcpConnection::*fp)(const std::string &message) = &TcpConnection::sendInLoop;
-            loop_->runInLoop(std::bind(fp, this, message->retrieveAllAsString()));
+            queueToLoop(std::bind(fp, this, message->retrieveAllAsString()));
+        }
+    }
+}
+
+bool TcpConnection::setBusyPoll(int usec)
+{
+    return socket_->setBusyPoll(usec);
+}
+
+void TcpConnection::setEdgeTriggered(bool on, bool keepWriteArmed)
+{
+    channel_->setEdgeTriggered(on);
+    channel_->setKeepWriteArmed(keepWriteArmed);
+}
+
+void TcpConnection::send(const OutputQueue::Block &block)
+{
+    OutputQueue pieces;
+    pieces.append(block);
+    send(&pieces);
+}
+
+void TcpConnection::sendBorrowed(const char *data, size_t len)
+{
+    OutputQueue pieces;
+    pieces.appendBorrowed(data, len);
+    send(&pieces);
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t length)
+{
+    OutputQueue pieces;
+    pieces.appendFile(fd, offset, length);
+    send(&pieces);
+}
+
+void TcpConnection::send(OutputQueue *pieces)
+{
+    if (state_ == kConnected)
+    {
+        if (isInLoopThread())
+        {
+            sendInLoop(pieces);
+        }
+        else
+        {
+            //任务只需要能移动,数据段交给unique_ptr独占,不用引用计数
+            std::unique_ptr<OutputQueue> moved(new OutputQueue);
+            moved->append(std::move(*pieces));
+            queueToLoop(std::bind(&TcpConnection::sendQueueInLoop, this, std::move(moved)));
         }
     }
 }
 
 void TcpConnection::sendInLoop(const std::string &message)
 {
+    TaskPlace place = taskPlace();
+    if (place == kDeferred || place == kElsewhere)
+    {
+        void (TcpConnection::*fp)(const std::string &message) = &TcpConnection::sendInLoop;
+        retryTask(std::bind(fp, this, message), place);
+        return;
+    }
     sendInLoop(message.data(), message.size());
 }
 
@@ -101,24 +233,35 @@ void TcpConnection::sendInLoop(const void *message, size_t len)
         LOG_WARN << "disconnected, give up writing";
         return;
     }
+    if (migrating_)
+    {
+        // 迁移开始前投递的数据,只放入输出队列,交接后由新loop发送
+        outputQueue_.append(static_cast<const char *>(message), len);
+        reportPendingBytes();
+        return;
+    }
     // 如果当前连接处于可写状态，就直接调用write()函数发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    if (!channel_->isWriting() && outputQueue_.empty())
     {//channel_->isWriting()为false，说明当前连接处于可写状态
     //如果channel_->isWriting()为true，说明当前连接处于不可写状态。表明上一次发送的数据没有发送完毕
-    //outputBuffer_.readableBytes()为0，说明发送缓冲区为空,可以直接发送数据。
+    //outputQueue_为空，说明发送缓冲区为空,可以直接发送数据。
     //如果发送缓冲区不为空，说明上一次发送的数据没有发送完毕，需要等待下一次可写事件再发送
     
         nwrote = ::write(channel_->fd(), message, len);
         //这里channel_->fd()返回的是socket的文件描述符
         if (nwrote >= 0)
         {
+            if (nwrote > 0)
+            {
+                touchIdle();
+            }
             remaining = len - nwrote;
             //如果发送的数据长度小于要发送的数据长度，
             //说明发送缓冲区已满，剩余的数据需要等待下一次可写事件再发送
             if (remaining == 0 && writeCompleteCallback_)
             {//如果发送的数据长度等于要发送的数据长度，说明发送缓冲区已经全部发送完毕
                 //此时调用writeCompleteCallback_()回调函数
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                ownerLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
                 //shared_from_this()返回一个shared_ptr对象，指向当前对象，这里是TcpConnection对象
             }
         }
@@ -139,18 +282,207 @@ void TcpConnection::sendInLoop(const void *message, size_t len)
 
     if (!faultError && remaining > 0)
     {
-        size_t oldLen = outputBuffer_.readableBytes();//发送缓冲区中已有的数据长度
+        size_t oldLen = outputQueue_.readableBytes();//发送缓冲区中已有的数据长度
         if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
         {//如果发送缓冲区中已有的数据长度加上要发送的数据长度大于highWaterMark_，说明发送缓冲区已满
-            loop_->queueInLoop(std::bind(
+            ownerLoop()->queueInLoop(std::bind(
                 highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
         }
-        outputBuffer_.append(static_cast<const char *>(message) + nwrote, remaining);
+        outputQueue_.append(static_cast<const char *>(message) + nwrote, remaining);
         if (!channel_->isWriting())
         {
             channel_->enableWriting();//注册可写事件
         }
     }
+    reportPendingBytes();
+}
+
+void TcpConnection::sendQueueInLoop(const std::unique_ptr<OutputQueue> &pieces)
+{
+    TaskPlace place = taskPlace();
+    if (place == kDeferred || place == kElsewhere)
+    {
+        std::unique_ptr<OutputQueue> moved(new OutputQueue);
+        moved->append(std::move(*pieces));
+        retryTask(std::bind(&TcpConnection::sendQueueInLoop, this, std::move(moved)), place);
+        return;
+    }
+    sendInLoop(pieces.get());
+}
+
+void TcpConnection::sendInLoop(OutputQueue *pieces)
+{
+    bool faultError = false;
+
+    if (state_ == kDisconnected)
+    {
+        LOG_WARN << "disconnected, give up writing";
+        return;
+    }
+    size_t oldLen = outputQueue_.readableBytes();
+    outputQueue_.append(std::move(*pieces));
+    if (migrating_)
+    {
+        reportPendingBytes();
+        return;
+    }
+    // 之前没有积压的数据,直接用writev把所有数据段一起写出
+    if (!channel_->isWriting())
+    {
+        int savedErrno = 0;
+        ssize_t n = outputQueue_.writeFd(channel_->fd(), &savedErrno);
+        if (n > 0)
+        {
+            touchIdle();
+        }
+        if (n >= 0)
+        {
+            if (outputQueue_.empty() && writeCompleteCallback_)
+            {
+                ownerLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+            }
+        }
+        if (savedErrno != 0 && savedErrno != EAGAIN && savedErrno != EWOULDBLOCK)
+        {
+            errno = savedErrno;
+            LOG_ERROR << "TcpConnection::sendInLoop";
+            if (savedErrno == EPIPE || savedErrno == ECONNRESET)
+            {
+                faultError = true;
+            }
+            else if (savedErrno == EIO)
+            {
+                // 文件数据不足,对端已经按声明的长度在等,只能关闭连接
+                faultError = true;
+                setState(kDisconnecting);
+                ownerLoop()->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+            }
+        }
+    }
+
+    if (!faultError && !outputQueue_.empty())
+    {
+        size_t newLen = outputQueue_.readableBytes();
+        if (newLen >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+        {
+            ownerLoop()->queueInLoop(std::bind(highWaterMarkCallback_, shared_from_this(), newLen));
+        }
+        if (!channel_->isWriting() && !waitForSource())
+        {
+            channel_->enableWriting();
+        }
+    }
+    reportPendingBytes();
+}
+
+void TcpConnection::reportPendingBytes()
+{
+    size_t pending = outputQueue_.readableBytes();
+    if (pending != reportedPendingBytes_)
+    {
+        getLoop()->addPendingBytes(static_cast<int64_t>(pending) - static_cast<int64_t>(reportedPendingBytes_));
+        reportedPendingBytes_ = pending;
+    }
+}
+
+void TcpConnection::releaseLoad()
+{
+    if (loadCounted_)
+    {
+        loadCounted_ = false;
+        getLoop()->addConnections(-1);
+        getLoop()->addPendingBytes(-static_cast<int64_t>(reportedPendingBytes_));
+        reportedPendingBytes_ = 0;
+    }
+}
+
+void TcpConnection::migrateTo(EventLoop *loop)
+{
+    // 总是排队执行,不能在本连接的事件处理过程中替换channel
+    queueToLoop(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), loop));
+}
+
+// 迁移分三步:
+// 1.原loop注销channel,把loop_切换到新loop,之后的任务都投递给新loop;
+//   切换之前已经进入原loop队列的发送任务只追加到输出队列
+// 2.原loop处理完队列中这些任务后交接:缓冲区的内存块还给原loop的内存池,ownerLoop_切换到新loop
+// 3.新loop创建channel并按原来的关注事件注册,之后恢复正常收发
+void TcpConnection::migrateInLoop(EventLoop *loop)
+{
+    TaskPlace place = taskPlace();
+    if (place != kRunHere)
+    {
+        retryTask(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), loop), place);
+        return;
+    }
+    EventLoop *oldLoop = getLoop();
+    if (loop == nullptr || loop == oldLoop || state_ != kConnected || !migratable_)
+    {
+        return;
+    }
+    LOG_INFO << "TcpConnection::migrateTo [" << name_ << "] fd=" << channel_->fd();
+    bool reading = channel_->isReading();
+    bool writing = channel_->isWriting() || waitingSource_;//新loop写的时候会重新判断管道是否为空
+    unwatchSource();
+    channel_->disableAll();
+    channel_->remove();
+    cancelIdle();
+    releaseLoad();
+    migrating_ = true;
+    {
+        std::lock_guard<std::mutex> lock(loopMutex_);
+        loop_.store(loop, std::memory_order_release);
+    }
+    loop->addConnections(1);
+    loadCounted_ = true;
+    // 排在切换之前投递的任务后面
+    oldLoop->queueInLoop(std::bind(&TcpConnection::handoffInLoop, shared_from_this(), loop, reading, writing));
+}
+
+void TcpConnection::handoffInLoop(EventLoop *loop, bool reading, bool writing)
+{
+    EventLoop *from = ownerLoop();
+    inputBuffer_.setPool(loop->chunkPool());
+    ownerLoop_.store(loop, std::memory_order_release);
+    loop->queueInLoop(std::bind(&TcpConnection::attachInLoop, shared_from_this(), from, reading, writing));
+}
+
+void TcpConnection::attachInLoop(EventLoop *from, bool reading, bool writing)
+{
+    bool edgeTriggered = channel_->isEdgeTriggered();
+    bool keepWriteArmed = channel_->keepWriteArmed();
+    channel_.reset(new Channel(getLoop(), socket_->fd()));
+    setupChannel();
+    channel_->setEdgeTriggered(edgeTriggered);
+    channel_->setKeepWriteArmed(keepWriteArmed);
+    channel_->tie(shared_from_this());
+    migrating_ = false;
+    reportPendingBytes();
+    touchIdle();
+    if (reading)
+    {
+        channel_->enableReading();
+    }
+    if (writing || !outputQueue_.empty())
+    {
+        channel_->enableWriting();
+    }
+    if (migrateCallback_)
+    {
+        migrateCallback_(shared_from_this(), from);
+    }
+    // 交接期间到达新loop的任务按到达顺序执行,它们都排在原loop转交的数据之后
+    std::vector<InlineFunction> tasks;
+    tasks.swap(deferredTasks_);
+    for (InlineFunction &task : tasks)
+    {
+        task();
+    }
+    // 迁移前没处理完的输入交给新loop处理,边沿触发时不会再有这部分数据的通知
+    if (inputBuffer_.readableBytes() > 0 && state_ == kConnected)
+    {
+        messageCallback_(shared_from_this(), &inputBuffer_, TimeStamp::now());
+    }
 }
 
 void TcpConnection::shutdown()
@@ -158,31 +490,101 @@ void TcpConnection::shutdown()
     if (state_ == kConnected)
     {
         setState(kDisconnecting);
-        loop_->runInLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        if (isInLoopThread())
+        {
+            shutdownInLoop();
+        }
+        else
+        {
+            queueToLoop(std::bind(&TcpConnection::shutdownInLoop, this));
+        }
     }
 }
 
 void TcpConnection::shutdownInLoop()
 {
+    TaskPlace place = taskPlace();
+    if (place != kRunHere)
+    {
+        retryTask(std::bind(&TcpConnection::shutdownInLoop, this), place);
+        return;
+    }
 
-    if (!channel_->isWriting())
+    if (!channel_->isWriting() && !waitingSource_)
     {
         socket_->shutdownWrite();
     }
 }
 
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        // 总是排队执行,调用方可能正处在本连接的回调中
+        queueToLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    TaskPlace place = taskPlace();
+    if (place != kRunHere)
+    {
+        retryTask(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()), place);
+        return;
+    }
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();
+    }
+}
+
+void TcpConnection::touchIdle()
+{
+    if (idleTimeout_ > 0)
+    {
+        ownerLoop()->timingWheel()->schedule(&idleEntry_, idleTimeout_);
+    }
+}
+
+void TcpConnection::cancelIdle()
+{
+    if (idleEntry_.scheduled())
+    {
+        ownerLoop()->timingWheel()->cancel(&idleEntry_);
+    }
+}
+
+void TcpConnection::onIdleTimeout()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        LOG_INFO << "TcpConnection::onIdleTimeout [" << name_ << "] - idle for "
+                 << idleTimeout_ << "s, closing";
+        handleClose();
+    }
+}
+
 void TcpConnection::connectEstablished()
 {
 
     setState(kConnected);
     channel_->tie(shared_from_this());
     channel_->enableReading();
+    touchIdle();
 
     connectionCallback_(shared_from_this());
 }
 
 void TcpConnection::connectDestroyed()
 {
+    TaskPlace place = taskPlace();
+    if (place != kRunHere)
+    {
+        retryTask(std::bind(&TcpConnection::connectDestroyed, shared_from_this()), place);
+        return;
+    }
     if (state_ == kConnected)
     {
         setState(kDisconnected);
@@ -190,15 +592,35 @@ void TcpConnection::connectDestroyed()
         connectionCallback_(shared_from_this());
     }
     channel_->remove();
+    unwatchSource();
+    cancelIdle();
+    releaseLoad();
+    // 在loop线程中把内存块还给内存池,连接对象之后可能在别的线程析构
+    inputBuffer_.retrieveAll();
+    inputBuffer_.releaseIdleStorage();
 }
 
 void TcpConnection::handleRead(TimeStamp receiveTime)
 {
+    if (channel_->isEdgeTriggered())
+    {
+        handleReadEdgeTriggered(receiveTime);
+        return;
+    }
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    // 每次可读事件最多读maxReadBytes字节,避免一个连接占住整轮循环,剩下的数据下一轮再读
+    size_t maxBytes = ownerLoop()->maxReadBytesPerConnection();
+    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno, maxBytes);
     if (n > 0)
     {
+        if (maxBytes > 0 && static_cast<size_t>(n) == maxBytes)
+        {
+            ownerLoop()->countReadBudgetHit();
+        }
+        touchIdle();
         messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        // 数据已经处理完,把存储还给loop的内存池,空闲连接不再占用缓冲区
+        inputBuffer_.releaseIdleStorage();
     }
     else if (n == 0)
     {
@@ -212,23 +634,176 @@ void TcpConnection::handleRead(TimeStamp receiveTime)
     }
 }
 
+// 边沿触发:读到EAGAIN为止,所有数据只回调一次messageCallback_
+// 读满上限还没读完时投递一个任务下一轮继续读,既不丢通知也不让一个连接占住整轮循环
+void TcpConnection::handleReadEdgeTriggered(TimeStamp receiveTime)
+{
+    size_t budget = ownerLoop()->maxReadBytesPerConnection();
+    if (budget == 0)
+    {
+        budget = kEdgeTriggeredReadBudget;
+    }
+    size_t total = 0;
+    bool drained = false;
+    bool eof = false;
+    bool error = false;
+    int savedErrno = 0;
+    while (total < budget)
+    {
+        ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno, budget - total);
+        if (n > 0)
+        {
+            total += n;
+        }
+        else if (n == 0)
+        {
+            eof = true;
+            break;
+        }
+        else if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
+        {
+            drained = true;
+            break;
+        }
+        else if (savedErrno != EINTR)
+        {
+            error = true;
+            break;
+        }
+    }
+
+    if (total > 0)
+    {
+        touchIdle();
+        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        inputBuffer_.releaseIdleStorage();
+    }
+    if (eof)
+    {
+        handleClose();
+    }
+    else if (error)
+    {
+        // 边沿触发下不会再有可读通知,出错直接关闭
+        errno = savedErrno;
+        LOG_ERROR << "TcpConnection::handleReadEdgeTriggered";
+        handleError();
+        handleClose();
+    }
+    else if (!drained)
+    {
+        ownerLoop()->countReadBudgetHit();
+        if (!readResumeQueued_)
+        {
+            readResumeQueued_ = true;
+            ownerLoop()->queueInLoop(std::bind(&TcpConnection::resumeEdgeTriggeredRead, shared_from_this()));
+        }
+    }
+}
+
+void TcpConnection::resumeEdgeTriggeredRead()
+{
+    TaskPlace place = taskPlace();
+    if (place != kRunHere)
+    {
+        retryTask(std::bind(&TcpConnection::resumeEdgeTriggeredRead, shared_from_this()), place);
+        return;
+    }
+    readResumeQueued_ = false;
+    if (state_ != kDisconnected && channel_->isReading())
+    {
+        handleReadEdgeTriggered(TimeStamp::now());
+    }
+}
+
+void TcpConnection::startRead()
+{
+    if (isInLoopThread())
+    {
+        startReadInLoop();
+    }
+    else
+    {
+        queueToLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::startReadInLoop()
+{
+    TaskPlace place = taskPlace();
+    if (place != kRunHere)
+    {
+        retryTask(std::bind(&TcpConnection::startReadInLoop, shared_from_this()), place);
+        return;
+    }
+    if (state_ == kDisconnected || (reading_ && channel_->isReading()))
+    {
+        return;
+    }
+    reading_ = true;
+    channel_->enableReading();
+    // 边沿触发时暂停期间到达的数据不会再有通知,主动读一次
+    if (channel_->isEdgeTriggered() && !readResumeQueued_)
+    {
+        readResumeQueued_ = true;
+        ownerLoop()->queueInLoop(std::bind(&TcpConnection::resumeEdgeTriggeredRead, shared_from_this()));
+    }
+}
+
+void TcpConnection::stopRead()
+{
+    if (isInLoopThread())
+    {
+        stopReadInLoop();
+    }
+    else
+    {
+        queueToLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    TaskPlace place = taskPlace();
+    if (place != kRunHere)
+    {
+        retryTask(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()), place);
+        return;
+    }
+    if (state_ == kDisconnected || (!reading_ && !channel_->isReading()))
+    {
+        return;
+    }
+    reading_ = false;
+    channel_->disableReading();
+}
+
 void TcpConnection::handleWrite()
 {
     if (channel_->isWriting())
     {
         int savedErrno = 0;
-        ssize_t n = ::write(channel_->fd(),
-                            outputBuffer_.beginWrite(), outputBuffer_.readableBytes());
-        //这里是写入socket的文件描述符
+        ssize_t n = outputQueue_.writeFd(channel_->fd(), &savedErrno);
+        //用writev把输出队列中的多个数据段一次写入socket
+        while (n > 0 && channel_->isEdgeTriggered() && !outputQueue_.empty())
+        {
+            //边沿触发时写到队列为空或者EAGAIN,否则剩下的数据要等下一次可写边沿
+            ssize_t more = outputQueue_.writeFd(channel_->fd(), &savedErrno);
+            if (more <= 0)
+            {
+                break;
+            }
+            n += more;
+        }
         if (n > 0)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            touchIdle();
+            if (outputQueue_.empty())
             {
                 channel_->disableWriting();
                 if (writeCompleteCallback_)
                 {
-                    loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                    ownerLoop()->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
                 }
                 if (state_ == kDisconnecting)
                 {
@@ -236,20 +811,98 @@ void TcpConnection::handleWrite()
                 }
             }
         }
-        else
+        if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
         {
+            // socket写满时等下一次可写;管道空了时socket一直可写,要改为等管道可读,否则会空转
+            if (waitForSource())
+            {
+                channel_->disableWriting();
+            }
+        }
+        else if (savedErrno != 0)
+        {
+            errno = savedErrno;
             LOG_ERROR << "TcpConnection::handleWrite";
+            if (savedErrno == EIO)
+            {
+                // 文件数据不足,继续发送后面的数据会破坏对端的分帧
+                reportPendingBytes();
+                handleClose();
+                return;
+            }
         }
+        reportPendingBytes();
     }else{
         LOG_TRACE << "Connection fd = " << channel_->fd() << " is down, no more writing";
     }
 }
 
+bool TcpConnection::waitForSource()
+{
+    int fd = outputQueue_.blockedPipeFd();
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (!waitingSource_)
+    {
+        waitingSource_ = true;
+        sourceChannel_.reset(new Channel(ownerLoop(), fd));
+        sourceChannel_->setReadCallback(std::bind(&TcpConnection::handleSourceReadable, this));
+        // 写端关闭时只有EPOLLHUP,同样交给handleWrite,读到结尾时按数据不足处理
+        sourceChannel_->setCloseCallback(std::bind(&TcpConnection::handleSourceReadable, this));
+        sourceChannel_->setErrorCallback(std::bind(&TcpConnection::handleSourceReadable, this));
+        sourceChannel_->tie(shared_from_this());
+        sourceChannel_->enableReading();
+    }
+    return true;
+}
+
+void TcpConnection::unwatchSource()
+{
+    if (waitingSource_)
+    {
+        waitingSource_ = false;
+        sourceChannel_->disableAll();
+        sourceChannel_->remove();
+    }
+}
+
+void TcpConnection::handleSourceReadable()
+{
+    if (waitingSource_)
+    {
+        unwatchSource();
+        // 不能在sourceChannel_自己的事件处理中析构它,下一轮再写
+        ownerLoop()->queueInLoop(std::bind(&TcpConnection::resumeWriteFromSource, shared_from_this()));
+    }
+}
+
+void TcpConnection::resumeWriteFromSource()
+{
+    if (taskPlace() != kRunHere)
+    {
+        return;//已经迁移,新loop会重新注册可写事件
+    }
+    if (!waitingSource_)
+    {
+        sourceChannel_.reset();
+    }
+    if ((state_ == kConnected || state_ == kDisconnecting) && !channel_->isWriting() && !outputQueue_.empty())
+    {
+        // 边沿触发时socket一直可写不会再有通知,所以直接写一次
+        channel_->enableWriting();
+        handleWrite();
+    }
+}
+
 void TcpConnection::handleClose()
 {
    
     setState(kDisconnected);
     channel_->disableAll();
+    unwatchSource();
+    cancelIdle();
 
     TcpConnectionPtr guardThis(shared_from_this());
     connectionCallback_(guardThis);
@@ -3,13 +3,20 @@
 
 #include "Callback.h"
 #include "Buffer.h"
+#include "OutputQueue.h"
 #include "InetAddress.h"
 #include "noncopyable.h"
 #include "TimeStamp.h"
+#include "InlineFunction.h"
+#include "TimingWheel.h"
+
+#include <atomic>
+#include <mutex>
 
 class Channel;
 class EventLoop;
 class Socket;
+class BufferBudget;
 
 //std::enable_shared_from_this<TcpConnection>是一个模板类，
 //它的作用是：让一个类可以安全地共享一个对象的所有权。
@@ -23,19 +30,65 @@ public:
                   const std::string &name,
                   int sockfd,
                   const InetAddress &localAddr,
-                  const InetAddress &peerAddr);
+                  const InetAddress &peerAddr,
+                  uint64_t id = 0);
     ~TcpConnection();
 
-    EventLoop *getLoop() const { return loop_; }
+    //连接当前所属的loop,迁移之后会改变,跨线程投递任务时以它为准
+    EventLoop *getLoop() const { return loop_.load(std::memory_order_acquire); }
     const std::string &name() const { return name_; }
+    //服务器内唯一的整数编号
+    uint64_t id() const { return id_; }
     const InetAddress &localAddress() { return localAddr_; }
     const InetAddress &peerAddress() { return peerAddr_; }
     bool connected() const { return state_ == kConnected; }
 
     void send(const std::string &buf);
+    void send(std::string &&buf);
     void send(Buffer *message);
+    //发送共享块,多个连接可以共用同一份数据而不拷贝
+    void send(const OutputQueue::Block &block);
+    //把pieces中的数据段整体转移到输出队列,用一次writev发出,pieces被清空
+    void send(OutputQueue *pieces);
+    //发送借用的数据,不拷贝,调用方需保证data在writeComplete回调之前有效
+    void sendBorrowed(const char *data, size_t len);
+    //零拷贝发送文件fd中[offset, offset+length)的区间,fd的所有权转移给连接,发送完毕后自动close
+    //普通文件用sendfile发送,管道用splice发送
+    void sendFile(int fd, off_t offset, size_t length);
 
     void shutdown();
+    //直接关闭连接,不等输出队列发完,可以在任意线程调用
+    void forceClose();
+
+    //连接空闲(没有收发数据)超过seconds秒后关闭,使用loop的时间轮,0表示不限制
+    //需在connectEstablished之前设置
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+
+    //暂停/恢复从socket读取数据,暂停期间数据留在内核接收缓冲区,由TCP流控限制对端,可以在任意线程调用
+    //用于上层协议暂时不能处理更多输入时(如流式响应没发完时对端继续发流水线请求)
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; }
+
+    //在socket上开启SO_BUSY_POLL
+    bool setBusyPoll(int usec);
+
+    //使用边沿触发:每次可读时读到EAGAIN(受loop的每连接读取上限约束),可写时写到EAGAIN
+    //大批量传输时减少epoll_wait和epoll_ctl的次数,需在connectEstablished之前设置
+    //keepWriteArmed为true时EPOLLOUT一直注册在epoll中,开关写事件不再调用epoll_ctl
+    void setEdgeTriggered(bool on, bool keepWriteArmed = false);
+
+    //输入缓冲区中还没处理的数据,只能在loop线程中访问
+    Buffer *inputBuffer() { return &inputBuffer_; }
+    //输出队列中还没写到socket的字节数,只能在loop线程中访问
+    size_t outputBytes() const { return outputQueue_.readableBytes(); }
+
+    //连接上的上下文槽,上层协议(如HttpServer)用它保存每个连接的解析状态
+    //存取时由调用方保证类型一致
+    void setContext(const std::shared_ptr<void> &context) { context_ = context; }
+    const std::shared_ptr<void> &getContext() const { return context_; }
+    template <typename T>
+    T *getContext() const { return static_cast<T *>(context_.get()); }
 
     void setConnectionCallback(const ConnectionCallback &cb)
     {
@@ -57,14 +110,34 @@ public:
         closeCallback_ = cb;
     }
 
+    void setMigrateCallback(const MigrateCallback &cb)
+    {
+        migrateCallback_ = cb;
+    }
+
     void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
     {
         highWaterMarkCallback_ = cb;
         highWaterMark_ = highWaterMark;
     }
     
+    //把输入缓冲区的内存占用统计到budget中,需在connectEstablished之前设置
+    void setBufferBudget(const std::shared_ptr<BufferBudget> &budget)
+    {
+        bufferBudget_ = budget;
+        inputBuffer_.setBudget(budget.get());
+    }
+
     void connectEstablished();
     void connectDestroyed();
+
+    //把连接迁移到loop,可以在任意线程调用;channel、输入输出缓冲区和回调都随连接转移,
+    //迁移前已经投递给原loop的数据仍按顺序在迁移后发出,不会丢失
+    //迁移在原loop的下一轮任务中进行,连接已经断开、正在关闭或者不允许迁移时什么都不做
+    void migrateTo(EventLoop *loop);
+    //上层协议有和loop绑定的状态(如正在流式发送响应)时关闭迁移,只能在loop线程中调用
+    void setMigratable(bool on) { migratable_ = on; }
+    bool migratable() const { return migratable_; }
     
 
 private:
@@ -76,23 +149,74 @@ private:
     };
     void setState(StateE s) { state_ = s; }
 
+    //排队执行的任务在当前线程中应该怎样处理
+    enum TaskPlace
+    {
+        kRunHere,   //连接所属loop的线程,直接执行
+        kOldLoop,   //迁移中的原loop还没交接,发送的数据只追加到输出队列,其余任务转交
+        kDeferred,  //迁移中的新loop还没接管,暂存到接管后按顺序执行
+        kElsewhere, //其他线程(如已经交接完的原loop),转交给连接当前所属的loop
+    };
+    TaskPlace taskPlace() const;
+    void retryTask(InlineFunction task, TaskPlace place);
+    //当前线程可以直接操作连接(迁移过程中不可以)
+    bool isInLoopThread() const;
+    //迁移过程中由原loop交接给新loop之前,缓冲区仍归原loop的线程访问
+    EventLoop *ownerLoop() const { return ownerLoop_.load(std::memory_order_acquire); }
+    //把任务投递给连接当前所属的loop,和迁移互斥,保证迁移开始前投递的任务都进入原loop的队列
+    void queueToLoop(InlineFunction task);
+    void setupChannel();
+    void migrateInLoop(EventLoop *loop);
+    void handoffInLoop(EventLoop *loop, bool reading, bool writing);
+    void attachInLoop(EventLoop *from, bool reading, bool writing);
+
     void handleRead(TimeStamp receiveTime);
+    void handleReadEdgeTriggered(TimeStamp receiveTime);
+    void resumeEdgeTriggeredRead();
+    void startReadInLoop();
+    void stopReadInLoop();
     void handleWrite();
+    //输出队列队首的管道暂时没有数据时,停止关注socket可写,改为等待管道可读
+    bool waitForSource();
+    void unwatchSource();
+    void handleSourceReadable();
+    void resumeWriteFromSource();
     void handleClose();
     void handleError();
 
     void sendInLoop(const std::string &message);
     void sendInLoop(const void *message, size_t len);
+    void sendInLoop(OutputQueue *pieces);
+    void sendQueueInLoop(const std::unique_ptr<OutputQueue> &pieces);
     void shutdownInLoop();
-
-
-    EventLoop *loop_;
+    void forceCloseInLoop();
+    void touchIdle();//收发数据后推迟空闲超时
+    void cancelIdle();
+    void onIdleTimeout();
+    void reportPendingBytes();//把输出队列长度的变化计入loop的负载统计
+    void releaseLoad();//从loop的负载统计中移除本连接
+
+
+    std::atomic<EventLoop *> loop_;//任务投递的目标,迁移开始时切换到新loop
+    std::atomic<EventLoop *> ownerLoop_;//可以访问缓冲区和channel的loop,交接时切换
+    std::atomic<bool> migrating_;//迁移开始到新loop注册好channel之前为true
+    std::atomic<bool> migratable_;//TcpServer的重新均衡在主loop中读取
+    std::mutex loopMutex_;//queueToLoop和迁移时切换loop_互斥
+    std::vector<InlineFunction> deferredTasks_;//新loop接管之前到达的任务,只在新loop线程中访问
     const std::string name_;
+    const uint64_t id_;
     std::atomic_int state_;//state_是一个原子变量，用于表示连接的状态
-    bool reading_;
+    bool reading_;//没有被stopRead暂停
+    bool readResumeQueued_;//边沿触发时读满上限还没读完,已经投递了继续读的任务
+    bool loadCounted_;//是否计入了loop的连接数
+    size_t reportedPendingBytes_;//已经计入loop的输出队列长度
+    double idleTimeout_;
+    TimingWheel::Entry idleEntry_;//在ownerLoop()的时间轮中
 
     std::unique_ptr<Socket> socket_;
     std::unique_ptr<Channel> channel_;
+    std::unique_ptr<Channel> sourceChannel_;//等待输出队列队首的管道可读
+    bool waitingSource_;
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
 
@@ -100,15 +224,18 @@ private:
     MessageCallback messageCallback_;
     WriteCompleteCallback writeCompleteCallback_;
     CloseCallback closeCallback_;
+    MigrateCallback migrateCallback_;
     HighWaterMarkCallback highWaterMarkCallback_;
     size_t highWaterMark_;
     //highWaterMark_是一个高水位标记，
     //用于表示当输出缓冲区中的数据量大于highWaterMark_时，
     //会调用highWaterMarkCallback_回调函数
 
+    std::shared_ptr<void> context_;//上层协议的连接上下文
+    std::shared_ptr<BufferBudget> bufferBudget_;//比inputBuffer_先构造后析构
     Buffer inputBuffer_;
-    Buffer outputBuffer_;
-    //inputBuffer_和outputBuffer_分别是输入缓冲区和输出缓冲区
+    OutputQueue outputQueue_;
+    //inputBuffer_是输入缓冲区,outputQueue_是由多个数据段组成的输出队列
 
 };
 
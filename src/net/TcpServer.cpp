@@ -1,9 +1,13 @@
 #include <functional>
 #include <string.h>
+#include <condition_variable>
+#include <algorithm>
+#include <sys/socket.h>
 
 #include "TcpServer.h"
 #include "TcpConnection.h"
 #include "Logging.h"
+#include "ChunkPool.h"
 
 static EventLoop *checkLoopNotNull(EventLoop *loop)
 {
@@ -14,6 +18,29 @@ static EventLoop *checkLoopNotNull(EventLoop *loop)
     return loop;
 }
 
+// 定时在loop线程中回收内存池,超出预算时释放全部空闲块
+static void trimBuffers(EventLoop *loop, const std::shared_ptr<BufferBudget> &budget)
+{
+    if (budget->overBudget())
+    {
+        LOG_WARN << "buffer memory over budget: reserved " << budget->reservedBytes()
+                 << " bytes, limit " << budget->limit() << " bytes";
+        loop->chunkPool()->shrink();
+    }
+    else
+    {
+        loop->chunkPool()->trim();
+    }
+}
+
+// 定时输出loop每秒的epoll_ctl次数,lastCalls保存上一次的累计值
+static void reportLoopStats(EventLoop *loop, double interval, const std::shared_ptr<uint64_t> &lastCalls)
+{
+    uint64_t calls = loop->epollCtlCalls();
+    LOG_INFO << "EventLoop " << loop << " epoll_ctl " << static_cast<uint64_t>((calls - *lastCalls) / interval) << "/s";
+    *lastCalls = calls;
+}
+
 TcpServer::TcpServer(EventLoop *loop,
                      const InetAddress &listenAddr,
                      const std::string &nameArg,
@@ -22,26 +49,73 @@ TcpServer::TcpServer(EventLoop *loop,
       ipPort_(listenAddr.toIpPort()),
       name_(nameArg),
       acceptor_(new Acceptor(loop, listenAddr, option == kReusePort)),
+      listenAddr_(listenAddr),
+      localAddr_(acceptor_->listenAddress()),
+      localAddrFixed_(localAddr_.getSockAddr()->sin_addr.s_addr != htonl(INADDR_ANY)),
+      connNamePrefix_(name_ + "-" + ipPort_ + "#"),
+      acceptorPerIoThread_(false),
+      maxAcceptsPerWakeup_(64),
       threadPool_(new EventLoopThreadPool(loop, name_)),
       connectionCallback_(),
       messageCallback_(),
       writeCompleteCallback_(),
       threadInitCallback_(),
       started_(0),
-      nextConnId_(1)
+      nextConnId_(1),
+      bufferBudget_(new BufferBudget),
+      bufferTrimInterval_(30.0),
+      busyPollMicros_(0),
+      socketBusyPollMicros_(0),
+      edgeTriggered_(false),
+      keepWriteArmed_(false),
+      loopStatsInterval_(0.0),
+      maxEventsPerPoll_(0),
+      maxFunctorsPerIteration_(0),
+      maxReadBytesPerConnection_(0),
+      rebalanceInterval_(0.0),
+      rebalanceRatio_(1.25),
+      maxMigrationsPerRound_(64),
+      idleTimeout_(0.0),
+      alive_(new char(0))
 {
     acceptor_->setNewConnectionCallback(
-        std::bind(&TcpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2));
+        std::bind(&TcpServer::newConnection, this, static_cast<EventLoop *>(nullptr),
+                  std::placeholders::_1, std::placeholders::_2));
 }
 
 TcpServer::~TcpServer()
 {
-    for(auto &item :connections_){
-        TcpConnectionPtr conn(item.second);
-        item.second.reset();
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn));
-        conn.reset();
+    // IO线程的监听套接字要在它自己的线程中注销,等它注销完,之后不会再回调newConnection
+    for (auto &acceptor : ioAcceptors_)
+    {
+        Acceptor *raw = acceptor.release();
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool done = false;
+        raw->getLoop()->runInLoop([raw, &mutex, &cond, &done]() {
+            delete raw;
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            cond.notify_one();
+        });
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&done]() { return done; });
+    }
+    for (auto &shard : shards_)
+    {
+        std::unordered_map<uint64_t, TcpConnectionPtr> connections;
+        {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            connections.swap(shard->connections);
+        }
+        for (auto &item : connections)
+        {
+            TcpConnectionPtr conn(item.second);
+            item.second.reset();
+            conn->getLoop()->runInLoop(
+                std::bind(&TcpConnection::connectDestroyed, conn));
+            conn.reset();
+        }
     }
 }
 
@@ -55,69 +129,320 @@ void TcpServer::start()
     if (started_++ == 0)
     {
         threadPool_->start(threadInitCallback_);
+        for (EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            shards_.push_back(std::unique_ptr<ConnectionShard>(new ConnectionShard));
+            shardByLoop_[ioLoop] = shards_.back().get();
+        }
+        if (busyPollMicros_ > 0)
+        {
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                ioLoop->setBusyPoll(busyPollMicros_);
+            }
+        }
+        for (EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            ioLoop->setMaxEventsPerPoll(maxEventsPerPoll_);
+            ioLoop->setMaxFunctorsPerIteration(maxFunctorsPerIteration_);
+            ioLoop->setMaxReadBytesPerConnection(maxReadBytesPerConnection_);
+        }
+        if (bufferTrimInterval_ > 0)
+        {
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                ioLoop->runEvery(bufferTrimInterval_, std::bind(trimBuffers, ioLoop, bufferBudget_));
+            }
+        }
+        if (loopStatsInterval_ > 0)
+        {
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                std::shared_ptr<uint64_t> lastCalls(new uint64_t(ioLoop->epollCtlCalls()));
+                ioLoop->runEvery(loopStatsInterval_, std::bind(reportLoopStats, ioLoop, loopStatsInterval_, lastCalls));
+            }
+        }
+        if (rebalanceInterval_ > 0)
+        {
+            std::weak_ptr<char> alive(alive_);
+            loop_->runEvery(rebalanceInterval_, [this, alive]() {
+                if (alive.lock())
+                {
+                    rebalance();
+                }
+            });
+        }
+    }
+
+    if (acceptorPerIoThread_ && ioAcceptors_.empty() && !acceptor_->listenning())
+    {
+        for (EventLoop *ioLoop : threadPool_->getAllLoops())
+        {
+            if (ioLoop == loop_)
+            {
+                break;//没有IO线程
+            }
+            std::unique_ptr<Acceptor> acceptor(new Acceptor(ioLoop, localAddr_, true));
+            acceptor->setMaxAcceptsPerRead(maxAcceptsPerWakeup_);
+            acceptor->setNewConnectionCallback(
+                std::bind(&TcpServer::newConnection, this, ioLoop,
+                          std::placeholders::_1, std::placeholders::_2));
+            ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor.get()));
+            ioAcceptors_.push_back(std::move(acceptor));
+        }
     }
 
-    if (!acceptor_->listenning())
+    if (ioAcceptors_.empty() && !acceptor_->listenning())
     {
+        acceptor_->setMaxAcceptsPerRead(maxAcceptsPerWakeup_);
         loop_->runInLoop(
             std::bind(&Acceptor::listen, 
             acceptor_.get()));
     }
 }
 
-void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
+uint64_t TcpServer::rejectedConnections() const
+{
+    uint64_t n = acceptor_->rejectedConnections();
+    for (const auto &acceptor : ioAcceptors_)
+    {
+        n += acceptor->rejectedConnections();
+    }
+    return n;
+}
+
+void TcpServer::newConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
 {
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof(buf), "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;
-    std::string connName = name_ + buf;
+    if (ioLoop == nullptr)
+    {
+        int incomingCpu = -1;
+        if (threadPool_->preferLocalNode())
+        {
+            socklen_t len = sizeof incomingCpu;
+            if (::getsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &incomingCpu, &len) < 0)
+            {
+                incomingCpu = -1;
+            }
+        }
+        ioLoop = threadPool_->getLoopForConnection(peerAddr, incomingCpu);
+    }
+    uint64_t connId = nextConnId_++;
+    std::string connName = connNamePrefix_ + std::to_string(connId);
 
     LOG_INFO << "TcpServer::newConnection [" << name_
              << "] - new connection [" << connName
              << "] from " << peerAddr.toIpPort();
 
-    sockaddr_in localAddr;
-    ::bzero(&localAddr, sizeof(localAddr));
-    socklen_t addrlen = sizeof(localAddr);
-    if (::getsockname(sockfd, (sockaddr *)&localAddr, &addrlen) < 0)
+    // 监听的是具体IP时本地地址就是监听地址,只有监听0.0.0.0时才需要getsockname
+    InetAddress localAddr(localAddr_);
+    if (!localAddrFixed_)
     {
-        LOG_ERROR << "sockets::getLocalAddr";
+        sockaddr_in addr;
+        ::bzero(&addr, sizeof(addr));
+        socklen_t addrlen = sizeof(addr);
+        if (::getsockname(sockfd, (sockaddr *)&addr, &addrlen) < 0)
+        {
+            LOG_ERROR << "sockets::getLocalAddr";
+        }
+        localAddr.setSockAddr(addr);
     }
-    InetAddress localAddr_(localAddr);
 
     TcpConnectionPtr conn(new TcpConnection(ioLoop,
                                             connName,
                                             sockfd,
-                                            localAddr_,
-                                            peerAddr));
-    connections_[connName] = conn;
+                                            localAddr,
+                                            peerAddr,
+                                            connId));
+    conn->setBufferBudget(bufferBudget_);
+    if (edgeTriggered_)
+    {
+        conn->setEdgeTriggered(true, keepWriteArmed_);
+    }
+    if (socketBusyPollMicros_ > 0)
+    {
+        conn->setBusyPoll(socketBusyPollMicros_);
+    }
+    if (idleTimeout_ > 0)
+    {
+        conn->setIdleTimeout(idleTimeout_);
+    }
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
 
     conn->setCloseCallback(
         std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    conn->setMigrateCallback(
+        std::bind(&TcpServer::onConnectionMigrated, this, std::placeholders::_1, std::placeholders::_2));
+    ioLoop->runInLoop(std::bind(&TcpServer::establishConnection, this, conn));
 
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+TcpServer::ConnectionShard *TcpServer::shardFor(EventLoop *loop) const
 {
-    loop_->runInLoop(
-        std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    auto it = shardByLoop_.find(loop);
+    return it == shardByLoop_.end() ? nullptr : it->second;
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+// 在连接所属的IO线程中登记,不经过主loop
+void TcpServer::establishConnection(const TcpConnectionPtr &conn)
 {
-    LOG_INFO << "TcpServer::removeConnectionInLoop [" << name_
+    ConnectionShard *shard = shardFor(conn->getLoop());
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->connections[conn->id()] = conn;
+    }
+    conn->connectEstablished();
+}
+
+// 由连接的closeCallback在所属IO线程中调用
+void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+{
+    LOG_INFO << "TcpServer::removeConnection [" << name_
              << "] - connection " << conn->name();
-    connections_.erase(conn->name());
     EventLoop *ioLoop = conn->getLoop();
+    ConnectionShard *shard = shardFor(ioLoop);
+    size_t erased = 0;
+    if (shard)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        erased = shard->connections.erase(conn->id());
+    }
+    if (erased == 0)
+    {
+        // 被迁移到了服务器以外的loop,仍然登记在原来的分片中
+        for (auto &other : shards_)
+        {
+            std::lock_guard<std::mutex> lock(other->mutex);
+            if (other->connections.erase(conn->id()) > 0)
+            {
+                break;
+            }
+        }
+    }
     ioLoop->queueInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn));
 }
 
+// 在新loop中调用,把连接从原来的分片移到新loop的分片
+void TcpServer::onConnectionMigrated(const TcpConnectionPtr &conn, EventLoop *from)
+{
+    ConnectionShard *oldShard = shardFor(from);
+    ConnectionShard *newShard = shardFor(conn->getLoop());
+    if (oldShard == nullptr || newShard == nullptr)
+    {
+        // 迁移目标不是服务器的IO线程,连接留在原来的分片中,关闭时再从那里移除
+        LOG_WARN << "TcpServer::onConnectionMigrated [" << name_
+                 << "] - connection " << conn->name() << " moved to a loop outside the server";
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(oldShard->mutex);
+        oldShard->connections.erase(conn->id());
+    }
+    std::lock_guard<std::mutex> lock(newShard->mutex);
+    newShard->connections[conn->id()] = conn;
+}
+
+void TcpServer::forEachInLoop(ConnectionShard *shard, const ConnectionCallback &cb)
+{
+    std::vector<TcpConnectionPtr> connections;
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        connections.reserve(shard->connections.size());
+        for (auto &item : shard->connections)
+        {
+            connections.push_back(item.second);
+        }
+    }
+    // 回调中可能关闭连接修改分片,所以先拷贝一份
+    for (const TcpConnectionPtr &conn : connections)
+    {
+        cb(conn);
+    }
+}
+
+void TcpServer::forEachConnection(const ConnectionCallback &cb)
+{
+    for (auto &item : shardByLoop_)
+    {
+        item.first->runInLoop(std::bind(&TcpServer::forEachInLoop, item.second, cb));
+    }
+}
+
+void TcpServer::shutdownAllConnections()
+{
+    forEachConnection(std::bind(&TcpConnection::shutdown, std::placeholders::_1));
+}
+
+size_t TcpServer::connectionCount() const
+{
+    size_t n = 0;
+    for (const auto &shard : shards_)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        n += shard->connections.size();
+    }
+    return n;
+}
+
+void TcpServer::rebalance()
+{
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    if (loops.size() < 2)
+    {
+        return;
+    }
+    EventLoop *busiest = loops[0];
+    EventLoop *idlest = loops[0];
+    int64_t total = 0;
+    for (EventLoop *ioLoop : loops)
+    {
+        int64_t n = ioLoop->connectionCount();
+        total += n;
+        if (n > busiest->connectionCount())
+        {
+            busiest = ioLoop;
+        }
+        if (n < idlest->connectionCount())
+        {
+            idlest = ioLoop;
+        }
+    }
+    int64_t most = busiest->connectionCount();
+    int64_t least = idlest->connectionCount();
+    double average = static_cast<double>(total) / loops.size();
+    if (most - least < 2 || most <= average * rebalanceRatio_)
+    {
+        return;
+    }
+    // 移走差值的一半,两个loop大致持平
+    int64_t count = std::min<int64_t>((most - least) / 2, maxMigrationsPerRound_);
+    std::vector<TcpConnectionPtr> moving;
+    ConnectionShard *shard = shardFor(busiest);
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        for (auto &item : shard->connections)
+        {
+            if (static_cast<int64_t>(moving.size()) >= count)
+            {
+                break;
+            }
+            const TcpConnectionPtr &conn = item.second;
+            if (conn->getLoop() == busiest && conn->connected() && conn->migratable())
+            {
+                moving.push_back(conn);
+            }
+        }
+    }
+    LOG_INFO << "TcpServer::rebalance [" << name_ << "] - move " << static_cast<int>(moving.size())
+             << " connections, " << static_cast<int>(most) << " -> " << static_cast<int>(least);
+    for (const TcpConnectionPtr &conn : moving)
+    {
+        conn->migrateTo(idlest);
+    }
+}
+
 // int main()
 // {
 //     LOG_INFO << "pid = " << getpid();
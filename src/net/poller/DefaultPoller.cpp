@@ -1,12 +1,19 @@
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "UringPoller.h"
 
 #include <stdlib.h>
 
 Poller* Poller::newDefaultPoller(EventLoop* loop){
     if(::getenv("MUDUO_USE_POLL")){
         return  nullptr;
-    }else{
-        return new EPollPoller(loop);
+    }else if(::getenv("TINY_NETWORK_USE_URING")){
+        //内核不支持io_uring时退回epoll
+        Poller* poller = UringPoller::create(loop);
+        if(poller){
+            return poller;
+        }
+        LOG_WARN << "io_uring unavailable, fall back to epoll";
     }
-}
\ No newline at end of file
+    return new EPollPoller(loop);
+}
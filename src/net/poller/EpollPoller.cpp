@@ -1,5 +1,6 @@
 #include "EPollPoller.h"
 #include <string>
+#include <algorithm>
 
 const int kNew = -1;//新建的Channel
 const int kAdded = 1;//已经添加到epoll中的Channel
@@ -27,9 +28,13 @@ EPollPoller::~EPollPoller()
 //这里的poll会阻塞在epoll_wait()函数上,直到有事件发生或者超时
 TimeStamp EPollPoller::poll(int timeoutMs, ChannelList* activeChannels)
 {
+    int maxEvents = static_cast<int>(events_.size());
+    if(maxEvents_ > 0 && maxEvents_ < maxEvents){
+        maxEvents = maxEvents_;//超出上限的就绪事件留给下一次epoll_wait
+    }
     size_t numEvents = ::epoll_wait(epollfd_,
                                     &(*events_.begin()),
-                                    static_cast<int>(events_.size()),
+                                    maxEvents,
                                     timeoutMs);
     //epoll_wait(epollfd, events, maxevents, timeout);
     //epoll_wait()函数用于等待事件的产生,类似于select()调用
@@ -64,11 +69,10 @@ void EPollPoller::updateChannel(Channel *channel){
         //如果是新建的Channel或者已经从epoll中删除的Channel
         int fd = channel->fd();
         if(index == kNew){//如果是新建的Channel,则添加到channels_中
-            channels_[fd] = channel;
+            channels_.add(fd, channel);
         }else{
             //检查channels_中是否有该Channel
-            assert(channels_.find(fd) != channels_.end());
-            assert(channels_[fd] == channel);
+            assert(channels_.find(fd) == channel);
         }
         channel->set_index(kAdded);
         update(EPOLL_CTL_ADD, channel);
@@ -80,22 +84,50 @@ void EPollPoller::updateChannel(Channel *channel){
             kDeleted状态只是用于标记该Channel对象已经被删除，
             以便于调试和错误检测，并不会影响该Channel对象的复用。
             */
-        }else{
+        }else if(!channel->updatePending()){
+            //推迟到下一次poll之前提交
+            channel->set_updatePending(true);
+            pendingUpdates_.push_back(channel);
+        }
+    }
+}
+
+void EPollPoller::flushUpdates(){
+    for(Channel* channel : pendingUpdates_){
+        channel->set_updatePending(false);
+        //期间被删除或重新添加的Channel已经提交过了
+        if(channel->index() == kAdded && kernelEvents(channel) != channel->registeredEvents()){
             update(EPOLL_CTL_MOD, channel);
         }
     }
+    pendingUpdates_.clear();
+}
+
+int EPollPoller::kernelEvents(Channel* channel){
+    int events = channel->events();
+    if(channel->isEdgeTriggered()){
+        events |= EPOLLET;
+        if(channel->keepWriteArmed()){
+            events |= EPOLLOUT;
+        }
+    }
+    return events;
 }
 
 void EPollPoller::fillActiveChannels(int numEvents, ChannelList* activeChannels) const{
     
     for(int i=0; i<numEvents; ++i){
         
-        Channel* channel = static_cast<Channel*>(events_[i].data.ptr);
-        
         //events_是一个epoll_event数组,每个元素都包含一个事件的数据
-        //data是一个联合体,包含一个指针和一个整数,这里用指针指向Channel
-        //data.ptr指向的是Channel对象
-        
+        //data是一个联合体,这里存放fd和注册时的代数,高32位是代数,低32位是fd
+        uint64_t data = events_[i].data.u64;
+        int fd = static_cast<int>(static_cast<uint32_t>(data));
+        Channel* channel = channels_.find(fd, static_cast<uint32_t>(data >> 32));
+        if(channel == nullptr){
+            LOG_TRACE << "stale event for fd " << fd;
+            continue;//fd已经被移除或复用
+        }
+
         channel->set_revents(events_[i].events);
         activeChannels->push_back(channel);
     }
@@ -104,7 +136,11 @@ void EPollPoller::fillActiveChannels(int numEvents, ChannelList* activeChannels)
 void EPollPoller::removeChannel(Channel *channel){
     int fd = channel->fd();//获取Channel的文件描述符
     LOG_TRACE << "fd = " << fd;
-    channels_.erase(fd);//从channels_中删除该Channel
+    channels_.remove(fd);//从channels_中删除该Channel
+    if(channel->updatePending()){
+        channel->set_updatePending(false);
+        pendingUpdates_.erase(std::find(pendingUpdates_.begin(), pendingUpdates_.end(), channel));
+    }
 
     int index = channel->index();//获取该Channel的状态,是否已经添加到epoll中
     //kNew:新建的Channel,kAdded:已经添加到epoll中的Channel,kDeleted:已经从epoll中删除的Channel
@@ -124,9 +160,10 @@ void EPollPoller::update(int operation,Channel *channel){
     epoll_event event;
     ::memset(&event, 0, sizeof(event));
     int fd = channel->fd();
-    event.events = channel->events();
-    event.data.fd = channel->fd();
-    event.data.ptr = channel;
+    event.events = kernelEvents(channel);
+    channel->set_registeredEvents(operation == EPOLL_CTL_DEL ? 0 : event.events);
+    ctlCalls_.fetch_add(1, std::memory_order_relaxed);
+    event.data.u64 = (static_cast<uint64_t>(channels_.generation(fd)) << 32) | static_cast<uint32_t>(fd);
     //epoll_ctl(epollfd, operation, fd, event);
     //epollfd:由epoll_create()函数生成的epoll专用的文件描述符
     //operation:表示对文件描述符的操作,有三种可能的值:
@@ -1,14 +1,15 @@
 #include "Poller.h"
 
 Poller::Poller(EventLoop* loop)
-    :ownerLoop_(loop)
+    :maxEvents_(0),
+     ctlCalls_(0),
+     ownerLoop_(loop)
 {
 }
 
 
 bool Poller::hasChannel(Channel* channel) const
 {
-    auto it = channels_.find(channel->fd());
-    return it != channels_.end() && it->second == channel;
+    return channels_.find(channel->fd()) == channel;
 }
 
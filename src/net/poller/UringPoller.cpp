@@ -0,0 +1,372 @@
+#include "UringPoller.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+//需要IORING_FEAT_EXT_ARG(5.11)带超时等待,以及multishot poll
+#if defined(IORING_FEAT_EXT_ARG) && defined(IORING_POLL_ADD_MULTI) && defined(__NR_io_uring_setup)
+#define URING_POLLER_SUPPORTED 1
+#endif
+
+static const int kNew = -1;//新建的Channel
+static const int kAdded = 1;//已经注册的Channel
+
+#ifdef URING_POLLER_SUPPORTED
+
+UringPoller* UringPoller::create(EventLoop* loop){
+    UringPoller* poller = new UringPoller(loop);
+    if(!poller->init()){
+        delete poller;
+        return nullptr;
+    }
+    return poller;
+}
+
+UringPoller::UringPoller(EventLoop* loop)
+    : Poller(loop),
+      ringFd_(-1),
+      sqRing_(MAP_FAILED),
+      sqRingSize_(0),
+      cqRing_(MAP_FAILED),
+      cqRingSize_(0),
+      sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)),
+      sqesSize_(0),
+      sqHead_(nullptr),
+      sqTail_(nullptr),
+      sqMask_(0),
+      sqEntries_(0),
+      cqHead_(nullptr),
+      cqTail_(nullptr),
+      cqMask_(0),
+      cqes_(nullptr),
+      generation_(0)
+{
+}
+
+bool UringPoller::init(){
+    io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+    ringFd_ = static_cast<int>(::syscall(__NR_io_uring_setup, kRingEntries, &params));
+    if(ringFd_ < 0){
+        LOG_WARN << "io_uring_setup failed, errno = " << errno;
+        return false;
+    }
+    //NODROP保证完成队列满时事件不会丢失
+    if(!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)){
+        LOG_WARN << "io_uring lacks EXT_ARG or NODROP, features = " << params.features;
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(singleMmap){
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd_, IORING_OFF_SQ_RING);
+    if(sqRing_ == MAP_FAILED){
+        LOG_WARN << "io_uring mmap sq ring failed";
+        return false;
+    }
+    if(singleMmap){
+        cqRing_ = sqRing_;
+    }else{
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ringFd_, IORING_OFF_CQ_RING);
+        if(cqRing_ == MAP_FAILED){
+            LOG_WARN << "io_uring mmap cq ring failed";
+            return false;
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                                              MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES));
+    if(sqes_ == MAP_FAILED){
+        LOG_WARN << "io_uring mmap sqes failed";
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sqRing_);
+    char* cq = static_cast<char*>(cqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    //提交队列的下标数组固定为恒等映射,sqe按顺序使用
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for(unsigned i = 0; i < sqEntries_; ++i){
+        array[i] = i;
+    }
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+UringPoller::~UringPoller(){
+    if(sqes_ != MAP_FAILED){
+        ::munmap(sqes_, sqesSize_);
+    }
+    if(cqRing_ != MAP_FAILED && cqRing_ != sqRing_){
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    if(sqRing_ != MAP_FAILED){
+        ::munmap(sqRing_, sqRingSize_);
+    }
+    if(ringFd_ >= 0){
+        ::close(ringFd_);
+    }
+}
+
+const char* UringPoller::name() const{
+    return "io_uring";
+}
+
+TimeStamp UringPoller::poll(int timeoutMs, ChannelList* activeChannels){
+    flushUpdates();
+    //先取已经完成的事件,没有事件时才等待;重新注册的请求和等待在同一次系统调用中提交
+    reap();
+    bool wait = activeFds_.empty() && timeoutMs != 0;
+    if(wait || *sqTail_ != __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE)){
+        submit(wait ? 1 : 0, timeoutMs);
+        reap();
+    }
+    TimeStamp now(TimeStamp::now());
+
+    for(int fd : activeFds_){
+        //getSqe在两次poll之间也可能取出完成事件,期间Channel可能已经被移除
+        Registration* found = findRegistration(fd);
+        if(found == nullptr || !found->active){
+            continue;
+        }
+        Registration& reg = *found;
+        reg.channel->set_revents(reg.revents);
+        activeChannels->push_back(reg.channel);
+        reg.revents = 0;
+        reg.active = false;
+    }
+    if(!activeFds_.empty()){
+        LOG_TRACE << activeFds_.size() << " events happend";
+    }
+    activeFds_.clear();
+    return now;
+}
+
+void UringPoller::updateChannel(Channel* channel){
+    int fd = channel->fd();
+    if(channel->index() == kNew){
+        channels_.add(fd, channel);
+        if(static_cast<size_t>(fd) >= registrations_.size()){
+            registrations_.resize(std::max(static_cast<size_t>(fd) + 1, registrations_.size() * 2));
+        }
+        registrations_[fd] = Registration();
+        registrations_[fd].channel = channel;
+        channel->set_index(kAdded);
+    }
+    //和epoll一样推迟到下一次poll之前提交
+    markDirty(registrations_[fd], fd);
+}
+
+void UringPoller::removeChannel(Channel* channel){
+    int fd = channel->fd();
+    channels_.remove(fd);
+    Registration* reg = findRegistration(fd);
+    if(reg){
+        if(reg->token != 0){
+            disarm(*reg);
+        }
+        *reg = Registration();
+    }
+    channel->set_index(kNew);
+}
+
+void UringPoller::flushUpdates(){
+    //提交队列满时getSqe会取出完成事件,可能向dirtyFds_追加,不能用迭代器遍历
+    for(size_t i = 0; i < dirtyFds_.size(); ++i){
+        int fd = dirtyFds_[i];
+        Registration* found = findRegistration(fd);
+        if(found == nullptr || !found->dirty){
+            continue;//期间已经被移除
+        }
+        Registration& reg = *found;
+        reg.dirty = false;
+        Channel* channel = reg.channel;
+        int events = channel->events();
+        if(channel->keepWriteArmed()){
+            events |= EPOLLOUT;
+        }
+        if(reg.token != 0 && reg.armedEvents == events){
+            continue;//和当前的poll请求相同
+        }
+        if(reg.token != 0){
+            disarm(reg);
+        }
+        if(events != 0){
+            arm(reg, fd, events);
+        }
+    }
+    dirtyFds_.clear();
+}
+
+UringPoller::Registration* UringPoller::findRegistration(int fd){
+    if(fd < 0 || static_cast<size_t>(fd) >= registrations_.size() || registrations_[fd].channel == nullptr){
+        return nullptr;
+    }
+    return &registrations_[fd];
+}
+
+void UringPoller::markDirty(Registration& reg, int fd){
+    if(!reg.dirty){
+        reg.dirty = true;
+        dirtyFds_.push_back(fd);
+    }
+}
+
+void UringPoller::arm(Registration& reg, int fd, int events){
+    if(++generation_ == 0){
+        ++generation_;
+    }
+    reg.token = (static_cast<uint64_t>(generation_) << 32) | static_cast<uint32_t>(fd);
+    reg.armedEvents = events;
+
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = static_cast<uint32_t>(reg.armedEvents);
+    //边沿触发用multishot,水平触发每次完成后重新注册
+    sqe->len = reg.channel->isEdgeTriggered() ? IORING_POLL_ADD_MULTI : 0u;
+    sqe->user_data = reg.token;
+    __atomic_store_n(sqTail_, *sqTail_ + 1, __ATOMIC_RELEASE);
+}
+
+void UringPoller::disarm(Registration& reg){
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = reg.token;
+    sqe->user_data = 0;//取消请求自身的完成事件直接忽略
+    __atomic_store_n(sqTail_, *sqTail_ + 1, __ATOMIC_RELEASE);
+    reg.token = 0;//旧请求之后的完成事件token对不上,会被丢弃
+    reg.armedEvents = 0;
+}
+
+io_uring_sqe* UringPoller::getSqe(){
+    //提交队列满了,先交给内核;内核可能只取走一部分,或者因为完成队列满了返回EBUSY,
+    //要一直等到有空位,否则会覆盖还没提交的sqe
+    while(*sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_){
+        int ret = submit(0, 0);
+        int savedErrno = errno;
+        if(ret < 0 && savedErrno != EBUSY && savedErrno != EAGAIN && savedErrno != EINTR){
+            LOG_FATAL << "UringPoller::getSqe io_uring_enter errno = " << savedErrno;
+        }
+        if(ret <= 0){
+            reap(false);//腾出完成队列,取出的事件在下一次poll中分发
+        }
+    }
+    io_uring_sqe* sqe = &sqes_[*sqTail_ & sqMask_];
+    ::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int UringPoller::submit(unsigned minComplete, int timeoutMs){
+    unsigned toSubmit = *sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    void* argp = nullptr;
+    size_t argSize = 0;
+    if(minComplete > 0){
+        flags |= IORING_ENTER_GETEVENTS;
+        if(timeoutMs > 0){
+            ::memset(&arg, 0, sizeof(arg));
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+            argp = &arg;
+            argSize = sizeof(arg);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+    int ret = static_cast<int>(::syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete,
+                                         flags, argp, argSize));
+    if(ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY){
+        LOG_ERROR << "UringPoller::submit io_uring_enter errno = " << errno;
+    }
+    return ret;
+}
+
+size_t UringPoller::reap(bool limited){
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    while(head != tail){
+        if(limited && maxEvents_ > 0 && activeFds_.size() >= static_cast<size_t>(maxEvents_)){
+            break;//剩下的完成事件留给下一次poll
+        }
+        const io_uring_cqe* cqe = &cqes_[head & cqMask_];
+        ++head;
+        uint64_t token = cqe->user_data;
+        if(token == 0){
+            continue;
+        }
+        int fd = static_cast<int>(static_cast<uint32_t>(token));
+        Registration* found = findRegistration(fd);
+        if(found == nullptr || found->token != token){
+            continue;//已经取消或重新注册的旧请求
+        }
+        Registration& reg = *found;
+        if(!(cqe->flags & IORING_CQE_F_MORE)){
+            //请求已经结束,下一次提交时重新注册
+            reg.token = 0;
+            reg.armedEvents = 0;
+            markDirty(reg, fd);
+        }
+        int revents = cqe->res;
+        if(revents < 0){
+            revents = (revents == -ECANCELED) ? 0 : static_cast<int>(EPOLLERR);
+        }
+        if(revents == 0){
+            continue;
+        }
+        reg.revents |= revents;
+        if(!reg.active){
+            reg.active = true;
+            activeFds_.push_back(fd);
+        }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return activeFds_.size();
+}
+
+#else
+
+UringPoller* UringPoller::create(EventLoop* loop){
+    LOG_WARN << "io_uring is not supported by this build";
+    return nullptr;
+}
+
+UringPoller::UringPoller(EventLoop* loop) : Poller(loop) {}
+UringPoller::~UringPoller() {}
+bool UringPoller::init() { return false; }
+TimeStamp UringPoller::poll(int, ChannelList*) { return TimeStamp::now(); }
+void UringPoller::updateChannel(Channel*) {}
+void UringPoller::removeChannel(Channel*) {}
+void UringPoller::flushUpdates() {}
+const char* UringPoller::name() const { return "io_uring"; }
+
+#endif
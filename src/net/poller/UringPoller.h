@@ -0,0 +1,81 @@
+#ifndef URING_POLLER_H
+#define URING_POLLER_H
+
+#include "Poller.h"
+#include "TimeStamp.h"
+
+#include <vector>
+#include <stdint.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//基于io_uring的Poller,不依赖liburing,直接使用io_uring_setup/io_uring_enter
+//每个Channel对应一个IORING_OP_POLL_ADD请求,关注事件的增删改和等待事件在同一次io_uring_enter中提交,
+//不再需要epoll_ctl,一轮循环只有一次系统调用
+//水平触发的Channel使用单次poll,每次完成后在下一次poll时重新注册,注册时就绪会立即完成,语义和epoll的LT相同
+//边沿触发的Channel使用multishot poll,只在被取消或出错时重新注册
+//内核不支持io_uring(或缺少EXT_ARG特性)时create返回nullptr,由newDefaultPoller退回epoll
+class UringPoller : public Poller
+{
+public:
+    static UringPoller* create(EventLoop* loop);
+    ~UringPoller() override;
+
+    TimeStamp poll(int timeoutMs, ChannelList* activeChannels) override;
+    void updateChannel(Channel* channel) override;
+    void removeChannel(Channel* channel) override;
+    void flushUpdates() override;
+    const char* name() const override;
+
+private:
+    static const unsigned kRingEntries = 1024;
+
+    //一个fd在io_uring中的poll请求
+    struct Registration
+    {
+        Registration() : channel(nullptr), token(0), armedEvents(0), revents(0), dirty(false), active(false) {}
+        Channel* channel;
+        uint64_t token;   //当前poll请求的user_data,0表示没有注册
+        int armedEvents;  //当前poll请求关注的事件
+        int revents;      //本轮收到的事件
+        bool dirty;       //需要在下一次提交前重新注册
+        bool active;      //本轮已经放入activeChannels
+    };
+
+    explicit UringPoller(EventLoop* loop);
+    bool init();
+
+    Registration* findRegistration(int fd);
+    void markDirty(Registration& reg, int fd);
+    void arm(Registration& reg, int fd, int events);
+    void disarm(Registration& reg);
+    io_uring_sqe* getSqe();
+    int submit(unsigned minComplete, int timeoutMs);
+    //取出完成事件,limited为true时受maxEvents_限制,剩下的留在完成队列中
+    size_t reap(bool limited = true);
+
+    int ringFd_;
+    void* sqRing_;
+    size_t sqRingSize_;
+    void* cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+
+    uint32_t generation_;//和fd一起组成token,fd复用后旧请求的完成事件会被丢弃
+    std::vector<Registration> registrations_;//按fd索引,channel为空表示没有注册
+    std::vector<int> dirtyFds_;
+    std::vector<int> activeFds_;
+};
+
+#endif
@@ -4,17 +4,16 @@
 
 #include "noncopyable.h"
 #include "TimeStamp.h"
-
-#include <functional>
+#include "InlineFunction.h"
 
 //定时器类，用于定时执行回调函数，定时器的超时时间是绝对时间
 class Timer : noncopyable
 {
 public:
-    using TimerCallback = std::function<void()>;
+    using TimerCallback = InlineFunction;
 
-    Timer(const TimerCallback& cb, TimeStamp when, double interval)
-        : callback_(move(cb)),//move 语义转移,避免拷贝,提高效率
+    Timer(TimerCallback&& cb, TimeStamp when, double interval)
+        : callback_(std::move(cb)),//move 语义转移,避免拷贝,提高效率
           expiration_(when),
           interval_(interval),
           repeat_(interval > 0.0)
@@ -64,11 +64,11 @@ TimerQueue::~TimerQueue()
 }
 
 
-void TimerQueue::addTimer(const TimerCallback& cb,
+void TimerQueue::addTimer(TimerCallback cb,
                             TimeStamp when,
                             double interval)
 {
-    Timer* timer = new Timer(cb, when, interval);
+    Timer* timer = new Timer(std::move(cb), when, interval);
     loop_->runInLoop(
         std::bind(&TimerQueue::addTimerInLoop, this, timer));
     //将定时器添加到loop_中,并且在loop_中执行,一直循环
@@ -0,0 +1,234 @@
+#include "TimingWheel.h"
+#include "EventLoop.h"
+
+#include <math.h>
+
+const double TimingWheel::kDefaultTick = 0.1;
+
+TimingWheel::Entry::~Entry()
+{
+    if (wheel_)
+    {
+        wheel_->cancel(this);
+    }
+}
+
+TimingWheel::TimingWheel(EventLoop *loop, double tick)
+    : loop_(loop),
+      tickSeconds_(tick),
+      tickMicros_(static_cast<int64_t>(tick * TimeStamp::kMicroSecondsPerSecond)),
+      start_(TimeStamp::now()),
+      currentTick_(0),
+      size_(0),
+      tickScheduled_(false)
+{
+}
+
+TimingWheel::~TimingWheel()
+{
+    // 条目由使用者持有,这里只解除关联
+    for (int level = 0; level < kLevels; ++level)
+    {
+        for (int slot = 0; slot < kSlots; ++slot)
+        {
+            Node *head = &wheel_[level][slot];
+            while (head->next != head)
+            {
+                Entry *entry = static_cast<Entry *>(head->next);
+                unlink(entry);
+                entry->wheel_ = nullptr;
+            }
+        }
+    }
+}
+
+void TimingWheel::link(Node *head, Node *node)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimingWheel::unlink(Node *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node;
+    node->next = node;
+}
+
+uint64_t TimingWheel::ticksFor(double delay) const
+{
+    if (delay <= 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(ceil(delay / tickSeconds_));
+}
+
+uint64_t TimingWheel::tickAt(TimeStamp time) const
+{
+    int64_t elapsed = time.microSecondsSinceEpoch() - start_.microSecondsSinceEpoch();
+    return elapsed > 0 ? static_cast<uint64_t>(elapsed / tickMicros_) : 0;
+}
+
+void TimingWheel::schedule(Entry *entry, double delay)
+{
+    if (size_ == 0 && !tickScheduled_)
+    {
+        // 空闲期间没有tick,直接跳到当前时间
+        uint64_t nowTick = tickAt(TimeStamp::now());
+        if (nowTick > currentTick_)
+        {
+            currentTick_ = nowTick;
+        }
+    }
+    // 以本轮poll返回的时间为准,不用每次都取当前时间
+    TimeStamp now = loop_->pollReturnTime();
+    if (now.microSecondsSinceEpoch() == 0)
+    {
+        now = TimeStamp::now();//loop还没有poll过
+    }
+    uint64_t expireTick = tickAt(now) + 1 + ticksFor(delay);
+    if (expireTick < currentTick_)
+    {
+        expireTick = currentTick_;
+    }
+    if (entry->wheel_ == this)
+    {
+        if (expireTick >= entry->expireTick_)
+        {
+            entry->expireTick_ = expireTick;//延后刷新,到了原来的槽再移动
+            return;
+        }
+        unlink(entry);
+    }
+    else
+    {
+        entry->wheel_ = this;
+        ++size_;
+    }
+    entry->expireTick_ = expireTick;
+    place(entry);
+    scheduleTick();
+}
+
+void TimingWheel::cancel(Entry *entry)
+{
+    if (entry->wheel_ == this)
+    {
+        unlink(entry);
+        entry->wheel_ = nullptr;
+        --size_;
+    }
+}
+
+void TimingWheel::place(Entry *entry)
+{
+    uint64_t expire = entry->expireTick_ < currentTick_ ? currentTick_ : entry->expireTick_;
+    uint64_t delta = expire - currentTick_;
+    if (delta > kMaxTicks)
+    {
+        // 超出时间轮范围,先放在最远的位置,到时再重新放置
+        delta = kMaxTicks;
+        expire = currentTick_ + kMaxTicks;
+    }
+    int level = 0;
+    while (level < kLevels - 1 && delta >= (static_cast<uint64_t>(1) << (kSlotBits * (level + 1))))
+    {
+        ++level;
+    }
+    uint64_t slot = (expire >> (kSlotBits * level)) & kSlotMask;
+    link(&wheel_[level][slot], entry);
+}
+
+void TimingWheel::cascade(int level, uint64_t slot)
+{
+    Node *head = &wheel_[level][slot];
+    Node pending;
+    if (head->next == head)
+    {
+        return;
+    }
+    // 先整体摘下来,重新放置时可能放回同一层
+    pending.next = head->next;
+    pending.prev = head->prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    head->next = head;
+    head->prev = head;
+    while (pending.next != &pending)
+    {
+        Entry *entry = static_cast<Entry *>(pending.next);
+        unlink(entry);
+        place(entry);
+    }
+}
+
+void TimingWheel::expire(Node *head)
+{
+    Node expired;
+    if (head->next == head)
+    {
+        return;
+    }
+    expired.next = head->next;
+    expired.prev = head->prev;
+    expired.next->prev = &expired;
+    expired.prev->next = &expired;
+    head->next = head;
+    head->prev = head;
+    // 回调中可能取消或刷新其他条目,每次只取一个
+    while (expired.next != &expired)
+    {
+        Entry *entry = static_cast<Entry *>(expired.next);
+        unlink(entry);
+        if (entry->expireTick_ > currentTick_)
+        {
+            place(entry);//到期前被刷新过
+        }
+        else
+        {
+            entry->wheel_ = nullptr;
+            --size_;
+            if (entry->callback_)
+            {
+                entry->callback_();
+            }
+        }
+    }
+}
+
+void TimingWheel::onTick()
+{
+    tickScheduled_ = false;
+    uint64_t target = tickAt(TimeStamp::now());
+    while (currentTick_ <= target)
+    {
+        if (size_ == 0)
+        {
+            currentTick_ = target + 1;
+            break;
+        }
+        uint64_t index = currentTick_ & kSlotMask;
+        // 低层转完一圈,把高层对应槽中的条目放到低层
+        for (int level = 1; index == 0 && level < kLevels; ++level)
+        {
+            index = (currentTick_ >> (kSlotBits * level)) & kSlotMask;
+            cascade(level, index);
+        }
+        expire(&wheel_[0][currentTick_ & kSlotMask]);
+        ++currentTick_;
+    }
+    scheduleTick();
+}
+
+void TimingWheel::scheduleTick()
+{
+    if (size_ > 0 && !tickScheduled_)
+    {
+        tickScheduled_ = true;
+        loop_->runAfter(tickSeconds_, std::bind(&TimingWheel::onTick, this));
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include "noncopyable.h"
+#include "TimeStamp.h"
+#include "InlineFunction.h"
+
+#include <stdint.h>
+
+class EventLoop;
+
+//分层时间轮,用于大量连接的空闲超时这类精度要求不高、频繁刷新的定时
+//4层,每层64个槽,最底层一个槽是一个tick,能表示64^4个tick,更远的到期时间先放在最高层,到时再重新放置
+//插入、刷新、取消都是O(1),只操作链表指针,不分配内存,也不调用timerfd_settime
+//到期的条目在tick时成批处理,实际到期时间比设定的晚不到一个tick
+//整个时间轮只使用loop的一个定时器,没有条目时不再tick
+//只能在所属loop的线程中使用
+class TimingWheel : noncopyable
+{
+public:
+    using Callback = InlineFunction;
+
+    //链表节点,每个槽的链表头也是一个节点
+    struct Node
+    {
+        Node() : prev(this), next(this) {}
+        Node *prev;
+        Node *next;
+    };
+
+    //时间轮中的一个定时条目,由使用者持有,析构时自动取消
+    class Entry : public Node, noncopyable
+    {
+    public:
+        explicit Entry(Callback cb = Callback())
+            : wheel_(nullptr),
+              expireTick_(0),
+              callback_(std::move(cb))
+        {
+        }
+        ~Entry();
+
+        void setCallback(Callback cb) { callback_ = std::move(cb); }
+        bool scheduled() const { return wheel_ != nullptr; }
+
+    private:
+        friend class TimingWheel;
+        TimingWheel *wheel_;//所在的时间轮,没有调度时为空
+        uint64_t expireTick_;//到期的tick,可能比所在的槽晚(延后刷新时不移动条目)
+        Callback callback_;
+    };
+
+    static const double kDefaultTick;
+
+    explicit TimingWheel(EventLoop *loop, double tick = kDefaultTick);
+    ~TimingWheel();
+
+    //delay秒后调用entry的回调;已经调度的条目重新设置到期时间
+    //到期时间只往后推的刷新(如每次收到数据时重置空闲超时)只记录新的到期tick,不移动条目,
+    //到了原来的槽再放到新的位置
+    void schedule(Entry *entry, double delay);
+    void cancel(Entry *entry);
+
+    size_t size() const { return size_; }
+    double tick() const { return tickSeconds_; }
+
+private:
+    static const int kLevels = 4;
+    static const int kSlotBits = 6;
+    static const int kSlots = 1 << kSlotBits;
+    static const uint64_t kSlotMask = kSlots - 1;
+    static const uint64_t kMaxTicks = (static_cast<uint64_t>(1) << (kLevels * kSlotBits)) - 1;
+
+    uint64_t ticksFor(double delay) const;
+    uint64_t tickAt(TimeStamp time) const;
+    //按到期tick放到对应层的槽中
+    void place(Entry *entry);
+    //把level层的slot槽中的条目重新放置到低层
+    void cascade(int level, uint64_t slot);
+    void expire(Node *head);
+    void onTick();
+    void scheduleTick();
+
+    static void link(Node *head, Node *node);
+    static void unlink(Node *node);
+
+    EventLoop *loop_;
+    const double tickSeconds_;
+    const int64_t tickMicros_;
+    const TimeStamp start_;//tick从这里开始计数
+    uint64_t currentTick_;//下一个要处理的tick
+    size_t size_;
+    bool tickScheduled_;
+    Node wheel_[kLevels][kSlots];
+};
+
+#endif